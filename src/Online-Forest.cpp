@@ -10,6 +10,10 @@
 #include "data.h"
 #include "onlinetree.h"
 #include "onlinerf.h"
+#include "workerpool.h"
+#include "exporter.h"
+#include "sweep.h"
+#include "crossvalidation.h"
 
 using namespace std;
 using namespace libconfig;
@@ -34,6 +38,11 @@ void help() {
     cout << "\t --train : \t train the classifier." << endl;
     cout << "\t --test : \t test the classifier." << endl;
     cout << "\t --t2 : \t train and test the classifier at the same time." << endl;
+    cout << "\t --save-bin : \t save the loaded data as dense binary files (<data file>.bin)." << endl;
+    cout << "\t --freeze : \t strip the training state of the ORT/ORF after training, before testing." << endl;
+    cout << "\t --export <file> : \t write the trained ORT/ORF as C++ source, with reference predictions on the test set in <file>.check." << endl;
+    cout << "\t --sweep <file> : \t train and test an ORF for every configuration of a sweep file, see conf/sweep.conf." << endl;
+    cout << "\t --cv <k> : \t k-fold cross-validation of the ORT/ORF on the training data, the folds run in parallel." << endl;
     cout << endl << endl;
     cout << "\tExamples:" << endl;
     cout << "\t ./Online-Forest -c conf/orf.conf --orf --train --test" << endl;
@@ -61,10 +70,46 @@ double timeIt(int reset) {
     }
 }
 
+//! Prints the metrics of the background training jobs
+void dispJobStats(const WorkerPoolStats &stats) {
+    cout << "GP training jobs: submitted " << stats.numSubmitted << ", rejected " << stats.numRejected;
+    cout << ", completed " << stats.numCompleted << ", queued " << stats.queueLength << endl;
+    cout << "GP training job latency (ms): wait " << stats.meanWaitTime << " (max " << stats.maxWaitTime << ")";
+    cout << ", run " << stats.meanRunTime << " (max " << stats.maxRunTime << ")" << endl;
+}
+
+//! Trains in memory, or out-of-core when the training data is read from a chunked file
+void train(Classifier &model, DataSet &dataset_tr, ChunkedDataFile *trainFile, const Hyperparameters &hp) {
+    if (trainFile != NULL) {
+        model.trainFromFile(*trainFile, hp);
+    } else {
+        model.train(dataset_tr);
+    }
+}
+
+//! Writes the trained model as C++ source, and its predictions on the test set for checking it
+template<class T>
+void exportModel(T &model, const Hyperparameters &hp, const DataSet &dataset_tr, DataSet *dataset_ts, const string &fileName) {
+    if (hp.quantizeBits) {
+        cout << "Can not export a model trained on quantized features." << endl;
+        return;
+    }
+    if (hp.leafModel != LEAF_MAJORITY) {
+        cout << "Can not export a model with leaf models, only majority vote leaves are exported." << endl;
+        return;
+    }
+
+    CodeExporter exporter(hp, dataset_tr.m_numClasses, dataset_tr.m_numFeatures);
+    exporter.write(model, fileName);
+    if (dataset_ts != NULL) {
+        CodeExporter::writeCheckFile(model, *dataset_ts, fileName + ".check");
+    }
+}
+
 int main(int argc, char *argv[]) {
     // Parsing command line
-    string confFileName;
-    int classifier = -1, doTraining = false, doTesting = false, doT2 = false, inputCounter = 1;
+    string confFileName, exportFileName, sweepFileName;
+    int classifier = -1, doTraining = false, doTesting = false, doT2 = false, doSaveBin = false, doFreeze = false, numFolds = 0, inputCounter = 1;
 	int enableGP = false;
 
     if (argc == 1) {
@@ -95,6 +140,16 @@ int main(int argc, char *argv[]) {
             doTesting = true;
         } else if (!strcmp(argv[inputCounter], "--t2")) {
             doT2 = true;
+        } else if (!strcmp(argv[inputCounter], "--save-bin")) {
+            doSaveBin = true;
+        } else if (!strcmp(argv[inputCounter], "--freeze")) {
+            doFreeze = true;
+        } else if (!strcmp(argv[inputCounter], "--export")) {
+            exportFileName = argv[++inputCounter];
+        } else if (!strcmp(argv[inputCounter], "--sweep")) {
+            sweepFileName = argv[++inputCounter];
+        } else if (!strcmp(argv[inputCounter], "--cv")) {
+            numFolds = atoi(argv[++inputCounter]);
         } else {
             cout << "\tUnknown input argument: " << argv[inputCounter];
             cout << ", please try --help for more information." << endl;
@@ -106,7 +161,7 @@ int main(int argc, char *argv[]) {
 
     cout << "OnlineMCBoost Classification Package:" << endl;
 
-    if (!doTraining && !doTesting && !doT2) {
+    if (!doTraining && !doTesting && !doT2 && !doSaveBin && sweepFileName.empty() && !numFolds) {
         cout << "\tNothing to do, no training, no testing !!!" << endl;
         exit(EXIT_FAILURE);
     }
@@ -116,15 +171,83 @@ int main(int argc, char *argv[]) {
         doTesting = false;
     }
 
+    if (doFreeze && classifier != ORT && classifier != ORF) {
+        cout << "Freezing is only available for --ort and --orf." << endl;
+        exit(EXIT_FAILURE);
+    }
+
     // Load the hyperparameters
     Hyperparameters hp(confFileName);
+    // Only the trees can work on packed binary features, dense rows or quantized features alone
+    bool isTreesOnly = (classifier == ORT || classifier == ORF || !sweepFileName.empty()) && hp.leafModel == LEAF_MAJORITY;
+    bool keepRawFeatures = !isTreesOnly || doSaveBin || !exportFileName.empty();
+    if (hp.quantizeBits && !isTreesOnly) {
+        cout << "Quantization is only available for --ort, --orf and --sweep with majority leaves, ";
+        cout << "the GP and leaf models need the raw features." << endl;
+        exit(EXIT_FAILURE);
+    }
     // Creating the train data
     DataSet dataset_tr, dataset_ts;
-    dataset_tr.loadTrain(hp);
-    if (doT2 || doTesting) {
+    dataset_tr.m_keepRawFeatures = keepRawFeatures;
+    dataset_ts.m_keepRawFeatures = keepRawFeatures;
+    ChunkedDataFile *trainFile = NULL;
+    if (doTraining && !doSaveBin && sweepFileName.empty() && !numFolds && hp.chunkSize > 0 && hp.trainData.substr(hp.trainData.find_last_of(".")) != ".bin") {
+        // Out-of-core training, only the sizes and the feature range are kept in memory
+        if (hp.trainData.substr(hp.trainData.find_last_of(".")) == ".libsvm") {
+            trainFile = new ChunkedDataFile(hp.trainData, hp.chunkSize);
+        } else {
+            trainFile = new ChunkedDataFile(hp.trainLabels, hp.trainData, hp.numTrain, hp.chunkSize);
+        }
+        trainFile->m_keepRawFeatures = keepRawFeatures;
+        trainFile->getInfo(dataset_tr);
+    } else {
+        dataset_tr.loadTrain(hp);
+    }
+    if (doT2 || doTesting || doSaveBin || !sweepFileName.empty()) {
       dataset_ts.loadTest(hp);
     }
 
+    // Quantize both sets with the training range, the trees map their thresholds into it
+    if (hp.quantizeBits && trainFile == NULL && !doSaveBin) {
+        dataset_tr.quantize(hp.quantizeBits, dataset_tr.m_minFeatRange, dataset_tr.m_maxFeatRange);
+        if (doT2 || doTesting || !sweepFileName.empty()) {
+            dataset_ts.quantize(hp.quantizeBits, dataset_tr.m_minFeatRange, dataset_tr.m_maxFeatRange);
+        }
+    }
+
+    if (doSaveBin) {
+        dataset_tr.saveDense(hp.trainData + ".bin");
+        dataset_ts.saveDense(hp.testData + ".bin");
+        if (!doTraining && !doTesting && !doT2 && sweepFileName.empty() && !numFolds) {
+            return EXIT_SUCCESS;
+        }
+    }
+
+    // The data is loaded once for all candidates of the sweep
+    if (!sweepFileName.empty()) {
+        int numParallel;
+        vector<Hyperparameters> candidates = loadSweep(hp, sweepFileName, numParallel);
+        runSweep(candidates, dataset_tr, dataset_ts, numParallel);
+        delete trainFile;
+        return EXIT_SUCCESS;
+    }
+
+    // The folds are index views on the training data
+    if (numFolds) {
+        if (classifier != ORT && classifier != ORF) {
+            cout << "Cross-validation is only available for --ort and --orf." << endl;
+            exit(EXIT_FAILURE);
+        }
+        crossValidate(hp, dataset_tr, numFolds, classifier == ORF);
+        delete trainFile;
+        return EXIT_SUCCESS;
+    }
+
+    // Background workers for the Gaussian Process training
+    if (classifier == ORTGP || classifier == ORFGP || classifier == OGP) {
+        WorkerPool::instance().start(hp.numWorkers, hp.maxQueueLength);
+    }
+
     // Calling training/testing
     switch (classifier) {
     case ORT: {
@@ -136,13 +259,20 @@ int main(int argc, char *argv[]) {
         }
         if (doTraining) {
             timeIt(1);
-            model.train(dataset_tr);
+            train(model, dataset_tr, trainFile, hp);
             cout << "Training time: " << timeIt(0) << endl;
-        } else if (doTesting) {
+        }
+        if (doFreeze) {
+            cout << "Froze the Online Random Tree, reclaimed " << model.freeze() / 1024 << " KB." << endl;
+        }
+        if (doTesting && !doTraining) {
             timeIt(1);
             model.test(dataset_ts);
             cout << "Test time: " << timeIt(0) << endl;
         }
+        if (!exportFileName.empty()) {
+            exportModel(model, hp, dataset_tr, (doT2 || doTesting) ? &dataset_ts : NULL, exportFileName);
+        }
         break;
     }
 	case ORTGP: {
@@ -155,7 +285,7 @@ int main(int argc, char *argv[]) {
         }
         if (doTraining) {
             timeIt(1);
-            model.train(dataset_tr);
+            train(model, dataset_tr, trainFile, hp);
             cout << "Training time: " << timeIt(0) << endl;
         } else if (doTesting) {
             timeIt(1);
@@ -174,14 +304,20 @@ int main(int argc, char *argv[]) {
         }
         if (doTraining) {
             timeIt(1);
-            model.train(dataset_tr);
+            train(model, dataset_tr, trainFile, hp);
             cout << "Training time: " << timeIt(0) << endl;
         }
+        if (doFreeze) {
+            cout << "Froze the Online Random Forest, reclaimed " << model.freeze() / 1024 << " KB." << endl;
+        }
         if (doTesting) {
             timeIt(1);
             model.test(dataset_ts);
             cout << "Test time: " << timeIt(0) << endl;
         }
+        if (!exportFileName.empty()) {
+            exportModel(model, hp, dataset_tr, (doT2 || doTesting) ? &dataset_ts : NULL, exportFileName);
+        }
         break;
     }
     case ORFGP: {
@@ -194,7 +330,7 @@ int main(int argc, char *argv[]) {
         }
         if (doTraining) {
             timeIt(1);
-            model.train(dataset_tr);
+            train(model, dataset_tr, trainFile, hp);
             cout << "Training time: " << timeIt(0) << endl;
         }
         if (doTesting) {
@@ -213,7 +349,7 @@ int main(int argc, char *argv[]) {
         }
         if (doTraining) {
             timeIt(1);
-            model.train(dataset_tr);
+            train(model, dataset_tr, trainFile, hp);
             cout << "Training time: " << timeIt(0) << endl;
         }
         if (doTesting) {
@@ -225,5 +361,11 @@ int main(int argc, char *argv[]) {
     }
     }
 
+    if (classifier == ORTGP || classifier == ORFGP || classifier == OGP) {
+        dispJobStats(WorkerPool::instance().getStats());
+    }
+
+    delete trainFile;
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,169 @@
+#ifndef CLASSHISTOGRAM_H_
+#define CLASSHISTOGRAM_H_
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//! Weighted class counts. While only a few classes have been seen, they are kept as a sorted
+//! list of (class, count) pairs, so nodes and tests of problems with thousands of classes stay
+//! small. Once the list would take more memory than a dense vector, it switches to one.
+//!
+//! The entries are always in increasing class order. In dense mode every class is an entry,
+//! zero counts included, so loops over the entries visit the classes in the same order as a
+//! loop over a dense vector.
+class ClassHistogram {
+public:
+    ClassHistogram() :
+        m_numClasses(0), m_isDense(false) {
+    }
+
+    explicit ClassHistogram(const int &numClasses) :
+        m_numClasses(numClasses), m_isDense(false) {
+    }
+
+    void add(const int &label, const double &weight) {
+        if (m_isDense) {
+            m_dense[label] += weight;
+            return;
+        }
+
+        vector<pair<int, double> >::iterator itr = lower_bound(m_sparse.begin(), m_sparse.end(), pair<int, double> (label, -HUGE_VAL));
+        if (itr != m_sparse.end() && itr->first == label) {
+            itr->second += weight;
+            return;
+        }
+        m_sparse.insert(itr, pair<int, double> (label, weight));
+
+        // A pair takes as much memory as two dense entries
+        if (2 * (int) m_sparse.size() > m_numClasses) {
+            m_dense.assign(m_numClasses, 0.0);
+            for (int i = 0; i < (int) m_sparse.size(); i++) {
+                m_dense[m_sparse[i].first] = m_sparse[i].second;
+            }
+            vector<pair<int, double> >().swap(m_sparse);
+            m_isDense = true;
+        }
+    }
+
+    double operator[](const int &label) const {
+        if (m_isDense) {
+            return m_dense[label];
+        }
+        vector<pair<int, double> >::const_iterator itr = lower_bound(m_sparse.begin(), m_sparse.end(),
+                                                                     pair<int, double> (label, -HUGE_VAL));
+        return (itr != m_sparse.end() && itr->first == label) ? itr->second : 0.0;
+    }
+
+    int numEntries() const {
+        return (m_isDense) ? m_numClasses : (int) m_sparse.size();
+    }
+
+    int entryLabel(const int &entry) const {
+        return (m_isDense) ? entry : m_sparse[entry].first;
+    }
+
+    double entryCount(const int &entry) const {
+        return (m_isDense) ? m_dense[entry] : m_sparse[entry].second;
+    }
+
+    //! Sum of all counts, added up in class order
+    double sum() const {
+        double val = 0.0;
+        for (int e = 0; e < numEntries(); e++) {
+            val += entryCount(e);
+        }
+        return val;
+    }
+
+    //! The class with the highest count, the lowest one on ties, as argmax() of a dense vector
+    int argmax() const {
+        int maxIndex = 0;
+        double maxValue = (*this)[0];
+        for (int e = 0; e < numEntries(); e++) {
+            if (entryCount(e) > maxValue) {
+                maxValue = entryCount(e);
+                maxIndex = entryLabel(e);
+            }
+        }
+        return maxIndex;
+    }
+
+    //! True if a single class holds all of totalCount
+    bool isPure(const double &totalCount) const {
+        if (numEntries() < m_numClasses && totalCount == 0.0) {
+            return true; // an unseen class has all of nothing
+        }
+        for (int e = 0; e < numEntries(); e++) {
+            if (entryCount(e) == totalCount) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //! -sum p log2(p) of the counts divided by totalCount
+    double entropy(const double &totalCount) const {
+        double p, val = 0.0;
+        for (int e = 0; e < numEntries(); e++) {
+            p = entryCount(e) / totalCount;
+            if (p) {
+                val -= p * log2(p);
+            }
+        }
+        return val;
+    }
+
+    //! Entropy of the sum of two histograms, with the classes in increasing order
+    static double entropy(const ClassHistogram &first, const ClassHistogram &second, const double &totalCount) {
+        double p, val = 0.0;
+        int e1 = 0, e2 = 0, n1 = first.numEntries(), n2 = second.numEntries();
+        while (e1 < n1 || e2 < n2) {
+            double count;
+            if (e2 == n2 || (e1 < n1 && first.entryLabel(e1) < second.entryLabel(e2))) {
+                count = first.entryCount(e1++);
+            } else if (e1 == n1 || second.entryLabel(e2) < first.entryLabel(e1)) {
+                count = second.entryCount(e2++);
+            } else {
+                count = first.entryCount(e1++) + second.entryCount(e2++);
+            }
+
+            p = count / totalCount;
+            if (p) {
+                val -= p * log2(p);
+            }
+        }
+        return val;
+    }
+
+    void scale(const double &factor) {
+        for (int i = 0; i < (int) m_dense.size(); i++) {
+            m_dense[i] *= factor;
+        }
+        for (int i = 0; i < (int) m_sparse.size(); i++) {
+            m_sparse[i].second *= factor;
+        }
+    }
+
+    //! Removes all counts and frees their memory
+    void clear() {
+        vector<double>().swap(m_dense);
+        vector<pair<int, double> >().swap(m_sparse);
+        m_isDense = false;
+    }
+
+    long memoryUsage() const {
+        return m_dense.capacity() * sizeof(double) + m_sparse.capacity() * sizeof(pair<int, double> );
+    }
+
+private:
+    int m_numClasses;
+    bool m_isDense;
+    vector<double> m_dense;
+    vector<pair<int, double> > m_sparse;
+};
+
+#endif /* CLASSHISTOGRAM_H_ */
@@ -1 +1,37 @@
 #include "classifier.h"
+#include "prefetcher.h"
+#include "utilities.h"
+
+void Classifier::trainFromFile(ChunkedDataFile &dataFile, const Hyperparameters &hp) {
+    // Double buffered: the next chunk is parsed while the current one is trained on
+    ChunkPrefetcher prefetcher(dataFile, 2);
+
+    vector<Sample> *chunkSamples;
+    vector<Sample*> block;
+    vector<int> chunkIndex, randIndex;
+    for (int n = 0; n < hp.numEpochs; n++) {
+        randPerm(dataFile.numChunks(), chunkIndex);
+        prefetcher.start(chunkIndex);
+
+        int c = 0;
+        while ((chunkSamples = prefetcher.next()) != NULL) {
+            randPerm(chunkSamples->size(), randIndex);
+            block.clear();
+            for (int i = 0; i < (int) chunkSamples->size(); i++) {
+                block.push_back(&(*chunkSamples)[randIndex[i]]);
+            }
+            updateBlock(block);
+            prefetcher.release(chunkSamples);
+
+            if (hp.verbose >= 1) {
+                cout << "--- Out-of-core training --- Epoch: " << n + 1 << " --- chunk ";
+                cout << ++c << " of " << dataFile.numChunks() << endl;
+            }
+        }
+    }
+    prefetcher.stop();
+
+    if (hp.verbose >= 1) {
+        cout << "--- Out-of-core training --- waited " << prefetcher.waitTime() << " ms for the reader" << endl;
+    }
+}
@@ -4,17 +4,34 @@
 #include <vector>
 
 #include "data.h"
+#include "hyperparameters.h"
 
 using namespace std;
 
 class Classifier {
 public:
+    virtual ~Classifier() {
+    }
+
     virtual void update(Sample &sample) = 0;
+
+    //! Updates with the samples in the given order. Models that can update in parallel
+    //! override it.
+    virtual void updateBlock(const vector<Sample*> &samples) {
+        for (int i = 0; i < (int) samples.size(); i++) {
+            update(*samples[i]);
+        }
+    }
+
     virtual void train(DataSet &dataset) = 0;
     virtual Result eval(Sample &sample) = 0;
     virtual vector<Result> test(DataSet & dataset) = 0;
     virtual vector<Result> trainAndTest(DataSet &dataset_tr, DataSet &dataset_ts) = 0;
 
+    //! Trains for hp.numEpochs over a file on disk. Every epoch visits the chunks in a new
+    //! random order and shuffles the samples within each chunk, only one chunk is in memory.
+    void trainFromFile(ChunkedDataFile &dataFile, const Hyperparameters &hp);
+
     double compError(const vector<Result> &results, const DataSet &dataset) {
         double error = 0.0;
         for (int i = 0; i < dataset.m_numSamples; i++) {
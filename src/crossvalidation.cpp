@@ -0,0 +1,123 @@
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "crossvalidation.h"
+#include "onlinerf.h"
+#include "onlinetree.h"
+#include "utilities.h"
+#include "workerpool.h"
+
+using namespace std;
+
+//! Trains and tests the model of one fold
+class FoldJob: public Job {
+public:
+    FoldJob(const Hyperparameters &foldHp, DataSet &dataset) :
+        hp(foldHp), trainSet(dataset), testSet(dataset), error(0.0) {
+        // The folds already run in parallel, and they would all talk at once
+        hp.numTreeWorkers = 0;
+        hp.verbose = 0;
+    }
+
+    Hyperparameters hp;
+    DataSetView trainSet;
+    DataSetView testSet;
+    bool useForest;
+    unsigned int seed;
+    double error;
+
+    virtual void run() {
+        // The fold gets the same random numbers on whichever worker it runs
+        seedRandom(seed);
+
+        DataSet &dataset = *trainSet.m_dataset;
+        Classifier *model;
+        if (useForest) {
+            model = new OnlineRF(hp, dataset.m_numClasses, dataset.m_numFeatures, dataset.m_minFeatRange,
+                                 dataset.m_maxFeatRange, 0);
+        } else {
+            model = new OnlineTree(hp, dataset.m_numClasses, dataset.m_numFeatures, dataset.m_minFeatRange,
+                                   dataset.m_maxFeatRange, 0);
+        }
+
+        vector<int> randIndex;
+        for (int n = 0; n < hp.numEpochs; n++) {
+            randPerm(trainSet.size(), randIndex);
+            for (int i = 0; i < trainSet.size(); i++) {
+                model->update(trainSet[randIndex[i]]);
+            }
+        }
+
+        for (int i = 0; i < testSet.size(); i++) {
+            if (model->eval(testSet[i]).prediction != testSet[i].y) {
+                error++;
+            }
+        }
+        error /= testSet.size();
+
+        delete model;
+    }
+};
+
+CrossValidationResult crossValidate(const Hyperparameters &hp, DataSet &dataset, const int &numFolds, const bool &useForest,
+                                    const int &numParallel) {
+    if (numFolds < 2 || numFolds > dataset.m_numSamples) {
+        cout << "Cross-validation needs between 2 and " << dataset.m_numSamples << " folds." << endl;
+        exit(EXIT_FAILURE);
+    }
+    int numThreads = (numParallel > 0) ? numParallel : max((int) thread::hardware_concurrency(), 1);
+    numThreads = min(numThreads, numFolds);
+
+    // Sample randIndex[i] goes to the test set of fold i % numFolds
+    vector<int> randIndex;
+    randPerm(dataset.m_numSamples, randIndex);
+
+    vector<FoldJob*> jobs;
+    for (int f = 0; f < numFolds; f++) {
+        FoldJob *job = new FoldJob(hp, dataset);
+        job->useForest = useForest;
+        job->seed = (unsigned int) randomEngine()();
+        for (int i = 0; i < dataset.m_numSamples; i++) {
+            if (i % numFolds == f) {
+                job->testSet.m_indices.push_back(randIndex[i]);
+            } else {
+                job->trainSet.m_indices.push_back(randIndex[i]);
+            }
+        }
+        jobs.push_back(job);
+    }
+
+    cout << "--- " << numFolds << "-fold cross-validation on " << dataset.m_numSamples << " samples, ";
+    cout << numThreads << " folds at a time" << endl;
+    Clock::time_point startTime = Clock::now();
+    WorkerPool pool;
+    pool.start(numThreads);
+    for (int f = 0; f < numFolds; f++) {
+        pool.submit(jobs[f]);
+    }
+
+    CrossValidationResult result;
+    for (int f = 0; f < numFolds; f++) {
+        jobs[f]->wait();
+        result.foldErrors.push_back(jobs[f]->error);
+        cout << "--- Fold " << f + 1 << " test error: " << jobs[f]->error << " (" << jobs[f]->testSet.size();
+        cout << " samples)" << endl;
+        delete jobs[f];
+    }
+    pool.stop();
+    result.wallTime = chrono::duration<double> (Clock::now() - startTime).count();
+
+    result.meanError = sum(result.foldErrors) / numFolds;
+    result.errorVariance = 0.0;
+    for (int f = 0; f < numFolds; f++) {
+        result.errorVariance += (result.foldErrors[f] - result.meanError) * (result.foldErrors[f] - result.meanError);
+    }
+    result.errorVariance /= numFolds - 1;
+
+    cout << "--- Cross-validation test error: mean " << result.meanError << ", variance " << result.errorVariance;
+    cout << ", standard deviation " << sqrt(result.errorVariance) << endl;
+    cout << "--- Cross-validation wall time: " << result.wallTime << " s" << endl;
+
+    return result;
+}
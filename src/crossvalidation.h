@@ -0,0 +1,28 @@
+#ifndef CROSSVALIDATION_H_
+#define CROSSVALIDATION_H_
+
+#include <vector>
+
+#include "data.h"
+#include "hyperparameters.h"
+
+using namespace std;
+
+//! Errors of a k-fold cross-validation
+class CrossValidationResult {
+public:
+    vector<double> foldErrors;
+    double meanError;
+    double errorVariance; // unbiased variance over the folds
+    double wallTime; // seconds
+};
+
+//! Splits the data set into numFolds random folds of (nearly) equal size, as index views, and
+//! for every fold trains an ORF (or an ORT without useForest) on the other folds and tests it
+//! on the fold. The folds run in parallel, up to numParallel at a time (0 = one per CPU), each
+//! with its own random number stream. Prints the error of every fold and their mean, variance
+//! and the wall time.
+CrossValidationResult crossValidate(const Hyperparameters &hp, DataSet &dataset, const int &numFolds, const bool &useForest,
+                                    const int &numParallel = 0);
+
+#endif /* CROSSVALIDATION_H_ */
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
+#include <algorithm>
 
 #include "data.h"
 
@@ -8,6 +9,24 @@ using namespace std;
 
 void DataSet::findFeatRange() {
     double minVal, maxVal;
+    if (!m_numSamples) {
+        m_minFeatRange.assign(m_numFeatures, 0.0);
+        m_maxFeatRange.assign(m_numFeatures, 0.0);
+        return;
+    }
+    if (!m_denseFeatures.empty()) {
+        m_minFeatRange.assign(m_denseFeatures.begin(), m_denseFeatures.begin() + m_numFeatures);
+        m_maxFeatRange = m_minFeatRange;
+        for (int n = 1; n < m_numSamples; n++) {
+            const float *row = &m_denseFeatures[(long) n * m_numFeatures];
+            for (int i = 0; i < m_numFeatures; i++) {
+                m_minFeatRange[i] = min(m_minFeatRange[i], (double) row[i]);
+                m_maxFeatRange[i] = max(m_maxFeatRange[i], (double) row[i]);
+            }
+        }
+        return;
+    }
+
     for (int i = 0; i < m_numFeatures; i++) {
         minVal = m_samples[0].x[i];
         maxVal = m_samples[0].x[i];
@@ -25,22 +44,322 @@ void DataSet::findFeatRange() {
     }
 }
 
+void readLIBSVMSample(istream &fp, const int &numFeatures, const int &startIndex, Sample &sample) {
+    string line, tmpStr;
+    int prePos, curPos, colIndex;
+
+    wsvector<double> x(numFeatures);
+    resize(sample.x, numFeatures);
+    fp >> sample.y; // read label
+    sample.w = 1.0; // set weight
+
+    getline(fp, line); // read the rest of the line
+    prePos = 0;
+    curPos = line.find(' ', 0);
+    while (prePos <= curPos) {
+        prePos = curPos + 1;
+        curPos = line.find(':', prePos);
+        tmpStr = line.substr(prePos, curPos - prePos);
+        colIndex = atoi(tmpStr.c_str()) - startIndex;
+
+        prePos = curPos + 1;
+        curPos = line.find(' ', prePos);
+        tmpStr = line.substr(prePos, curPos - prePos);
+        x[colIndex] = atof(tmpStr.c_str());
+    }
+    copy(x, sample.x);
+}
+
+void readRGBDSample(istream &fData, istream &fLabels, const int &numFeatures, Sample &sample) {
+    wsvector<double> x(numFeatures);
+    resize(sample.x, numFeatures);
+    fLabels >> sample.y; // read label
+    sample.w = 1.0; // set weight
+
+    for (int colIndex = 0; colIndex < numFeatures; colIndex++) {
+        float f;
+        fData >> f;
+        x[colIndex] = (double) f;
+    }
+    copy(x, sample.x);
+}
+
+void packBits(Sample &sample, const int &numFeatures, const bool &keepRawFeatures) {
+    int numBlocks = (numFeatures + 63) / 64, numOnes = (int) sample.x.nb_stored();
+    sample.bits.clear();
+    sample.ones.clear();
+    if (numBlocks * sizeof(BitBlock) <= numOnes * sizeof(int)) {
+        sample.bits.assign(numBlocks, 0);
+        for (SparseVector::const_iterator itr = sample.x.begin(); itr != sample.x.end(); ++itr) {
+            sample.bits[itr.index() >> 6] |= (BitBlock) 1 << (itr.index() & 63);
+        }
+    } else {
+        sample.ones.reserve(numOnes);
+        for (SparseVector::const_iterator itr = sample.x.begin(); itr != sample.x.end(); ++itr) {
+            sample.ones.push_back((int) itr.index());
+        }
+    }
+
+    if (!keepRawFeatures) {
+        // Same dimension, so x still reads as all zeros
+        SparseVector(numFeatures).swap(sample.x);
+    }
+}
+
+void DataSet::findBinaryFeatures() {
+    m_isBinary = true;
+    for (int n = 0; n < m_numSamples && m_isBinary; n++) {
+        for (SparseVector::const_iterator itr = m_samples[n].x.begin(); itr != m_samples[n].x.end(); ++itr) {
+            if (*itr != 1.0) {
+                m_isBinary = false;
+                break;
+            }
+        }
+    }
+
+    // Pack the set features, the projections then only look them up
+    for (int n = 0; n < m_numSamples; n++) {
+        if (m_isBinary) {
+            packBits(m_samples[n], m_numFeatures, m_keepRawFeatures);
+        } else {
+            m_samples[n].bits.clear();
+            m_samples[n].ones.clear();
+        }
+    }
+}
+
+//! Clamps a value to the range starting at minValue, then rounds it to the nearest level
+static inline double quantizeValue(const double &value, const double &minValue, const double &scale, const double &levels) {
+    return floor(min(max(value - minValue, 0.0) * scale, levels) + 0.5);
+}
+
+//! Quantizes all rows into 'codes', which is resized to numSamples x numFeatures
+template<class T>
+static void quantizeRows(vector<Sample> &samples, const int &numFeatures, const int &bits, const vector<double> &minFeatRange,
+                         const vector<double> &maxFeatRange, vector<T> &codes) {
+    double levels = (1 << bits) - 1;
+    vector<double> scale(numFeatures, 0.0);
+    vector<T> zeroCodes(numFeatures, 0);
+    for (int j = 0; j < numFeatures; j++) {
+        if (maxFeatRange[j] > minFeatRange[j]) {
+            scale[j] = levels / (maxFeatRange[j] - minFeatRange[j]);
+        }
+    }
+
+    for (int j = 0; j < numFeatures; j++) {
+        zeroCodes[j] = (T) quantizeValue(0.0, minFeatRange[j], scale[j], levels);
+    }
+
+    codes.resize((long) samples.size() * numFeatures);
+    for (int n = 0; n < (int) samples.size(); n++) {
+        T *row = &codes[(long) n * numFeatures];
+        const Sample &sample = samples[n];
+        if (sample.dense != NULL) {
+            for (int j = 0; j < numFeatures; j++) {
+                row[j] = (T) quantizeValue(sample.dense[j], minFeatRange[j], scale[j], levels);
+            }
+        } else {
+            copy(zeroCodes.begin(), zeroCodes.end(), row);
+            for (SparseVector::const_iterator itr = sample.x.begin(); itr != sample.x.end(); ++itr) {
+                row[itr.index()] = (T) quantizeValue(*itr, minFeatRange[itr.index()], scale[itr.index()], levels);
+            }
+        }
+    }
+}
+
+void DataSet::quantize(const int &bits, const vector<double> &minFeatRange, const vector<double> &maxFeatRange) {
+    if (m_isBinary) {
+        cout << "Binary features are already packed, they are not quantized." << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (m_denseFeatures.empty()) {
+        long numSparseBytes = 0;
+        for (int n = 0; n < m_numSamples; n++) {
+            numSparseBytes += m_samples[n].x.nb_stored() * sizeof(elt_rsvector_<double>);
+        }
+        long numCodeBytes = (long) m_numSamples * m_numFeatures * (bits / 8);
+        if (numCodeBytes >= numSparseBytes) {
+            cout << "The " << bits << " bit codes would take " << numCodeBytes / 1024 << " KB, more than the ";
+            cout << numSparseBytes / 1024 << " KB of the sparse features, they are not quantized." << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (bits == 8) {
+        quantizeRows(m_samples, m_numFeatures, bits, minFeatRange, maxFeatRange, m_quant8);
+    } else if (bits == 16) {
+        quantizeRows(m_samples, m_numFeatures, bits, minFeatRange, maxFeatRange, m_quant16);
+    } else {
+        cout << "Can only quantize to 8 or 16 bits, not " << bits << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    for (int n = 0; n < m_numSamples; n++) {
+        Sample &sample = m_samples[n];
+        if (bits == 8) {
+            sample.quant8 = &m_quant8[(long) n * m_numFeatures];
+        } else {
+            sample.quant16 = &m_quant16[(long) n * m_numFeatures];
+        }
+
+        SparseVector().swap(sample.x);
+        sample.dense = NULL;
+    }
+    vector<float>().swap(m_denseFeatures);
+
+    cout << "Quantized " << m_numSamples << " samples to " << bits << " bits." << endl;
+}
+
 void DataSet::loadTrain(Hyperparameters hp) {
     if(hp.trainData.substr(hp.trainData.find_last_of(".")) == ".libsvm") {
 	loadLIBSVM(hp.trainData);
+    } else if(hp.trainData.substr(hp.trainData.find_last_of(".")) == ".bin") {
+	loadDense(hp.trainData, hp.numTrain);
     } else {
 	loadRGBD(hp.trainLabels, hp.trainData, hp.numTrain);
     }
 }
 
 void DataSet::loadTest(Hyperparameters hp) {
-    if(hp.trainData.substr(hp.trainData.find_last_of(".")) == ".libsvm") {
+    if(hp.testData.substr(hp.testData.find_last_of(".")) == ".libsvm") {
 	loadLIBSVM(hp.testData);
+    } else if(hp.testData.substr(hp.testData.find_last_of(".")) == ".bin") {
+	loadDense(hp.testData, hp.numTest);
     } else {
 	loadRGBD(hp.testLabels, hp.testData, hp.numTest);
     }
 }
 
+static const char denseMagic[4] = { 'O', 'R', 'F', 'D' };
+
+void DataSet::loadDense(string filename, int n_samples = 0) {
+    ifstream fp(filename.c_str(), ios::binary);
+    if (!fp) {
+        cout << "Could not open input file " << filename << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    cout << "Loading data file: " << filename << " ... " << endl;
+
+    // Reading the header
+    char magic[4];
+    int header[3];
+    fp.read(magic, sizeof(magic));
+    fp.read((char *) header, sizeof(header));
+    if (!fp || !equal(magic, magic + 4, denseMagic) || header[0] < 0 || header[1] <= 0 || header[2] <= 0) {
+        cout << "Not a dense binary data file: " << filename << endl;
+        exit(EXIT_FAILURE);
+    }
+    int numRows = header[0];
+    m_numFeatures = header[1];
+    m_numClasses = header[2];
+    m_numSamples = (n_samples > numRows || n_samples == 0) ? numRows : n_samples;
+
+    // A truncated file must not make us allocate the sizes of its header
+    long headerSize = fp.tellg();
+    fp.seekg(0, ios::end);
+    long dataSize = (long) fp.tellg() - headerSize - (long) numRows * sizeof(int);
+    fp.seekg(headerSize);
+    if (dataSize < 0 || dataSize / ((long) m_numFeatures * sizeof(float)) < m_numSamples) {
+        cout << "Could not load " << m_numSamples << " samples from " << filename << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Reading the labels and then all features with a single read
+    vector<int> labels(numRows);
+    m_denseFeatures.resize((long) m_numSamples * m_numFeatures);
+    if (numRows > 0) {
+        fp.read((char *) &labels[0], numRows * sizeof(int));
+    }
+    if (!m_denseFeatures.empty()) {
+        fp.read((char *) &m_denseFeatures[0], m_denseFeatures.size() * sizeof(float));
+    }
+    if (!fp) {
+        cout << "Could not load " << m_numSamples << " samples from " << filename << endl;
+        exit(EXIT_FAILURE);
+    }
+    fp.close();
+
+    // The labels index the class statistics of the trees
+    for (int i = 0; i < m_numSamples; i++) {
+        if (labels[i] < 0 || labels[i] >= m_numClasses) {
+            cout << "Label " << labels[i] << " of sample " << i << " is not in [0, " << m_numClasses << ") in ";
+            cout << filename << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // The trees read the rows, a sparse copy is only made for the GP and leaf models, or to
+    // pack binary rows
+    bool isBinary = true;
+    for (long k = 0; k < (long) m_denseFeatures.size() && isBinary; k++) {
+        isBinary = (m_denseFeatures[k] == 0.0f || m_denseFeatures[k] == 1.0f);
+    }
+    bool makeSparse = m_keepRawFeatures || isBinary;
+
+    m_samples.clear();
+    m_samples.resize(m_numSamples);
+    for (int i = 0; i < m_numSamples; i++) {
+        Sample &sample = m_samples[i];
+        sample.y = labels[i];
+        sample.w = 1.0;
+        sample.dense = &m_denseFeatures[(long) i * m_numFeatures];
+
+        // The rows are appended in index order, so w() does not shift any entry
+        resize(sample.x, m_numFeatures);
+        for (int j = 0; j < m_numFeatures && makeSparse; j++) {
+            if (sample.dense[j]) {
+                sample.x.w(j, sample.dense[j]);
+            }
+        }
+    }
+
+    // Find the data range
+    findFeatRange();
+    if (makeSparse) {
+        findBinaryFeatures();
+    } else {
+        m_isBinary = false;
+    }
+
+    // The packed features replace the rows
+    if (m_isBinary && !m_keepRawFeatures) {
+        for (int i = 0; i < m_numSamples; i++) {
+            m_samples[i].dense = NULL;
+        }
+        vector<float>().swap(m_denseFeatures);
+    }
+
+    cout << "Loaded " << m_numSamples << ((m_isBinary) ? " binary" : " dense") << " samples with " << m_numFeatures;
+    cout << " features and " << m_numClasses << " classes." << endl;
+}
+
+void DataSet::saveDense(string filename) const {
+    ofstream fp(filename.c_str(), ios::binary);
+    if (!fp) {
+        cout << "Could not open output file " << filename << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    int header[3] = { m_numSamples, m_numFeatures, m_numClasses };
+    fp.write(denseMagic, sizeof(denseMagic));
+    fp.write((const char *) header, sizeof(header));
+    for (int i = 0; i < m_numSamples; i++) {
+        fp.write((const char *) &m_samples[i].y, sizeof(int));
+    }
+
+    vector<float> row(m_numFeatures);
+    for (int i = 0; i < m_numSamples; i++) {
+        row.assign(m_numFeatures, 0.0f);
+        for (SparseVector::const_iterator itr = m_samples[i].x.begin(); itr != m_samples[i].x.end(); ++itr) {
+            row[itr.index()] = (float) *itr;
+        }
+        fp.write((const char *) &row[0], m_numFeatures * sizeof(float));
+    }
+
+    cout << "Saved " << m_numSamples << " samples to " << filename << endl;
+}
+
 
 void DataSet::loadRGBD(string fileLabels, string fileData, int n_samples = 0) {
     ifstream fData(fileData.c_str());
@@ -75,19 +394,8 @@ void DataSet::loadRGBD(string fileLabels, string fileData, int n_samples = 0) {
     m_samples.clear();
  
     for (int i = 0; i < m_numSamples; i++) {
-        wsvector<double> x(m_numFeatures);
         Sample sample;
-        resize(sample.x, m_numFeatures);
-        fLabels >> sample.y; // read label
-        sample.w = 1.0; // set weight
-
-	for (int colIndex = 0; colIndex < m_numFeatures; colIndex++) {
-	    float f;
-	    fData >> f; 
-	    x[colIndex] = (double) f;
-	}
-
-        copy(x, sample.x);
+        readRGBDSample(fData, fLabels, m_numFeatures, sample);
         m_samples.push_back(sample); // push sample into dataset
     }
 
@@ -102,8 +410,9 @@ void DataSet::loadRGBD(string fileLabels, string fileData, int n_samples = 0) {
 
     // Find the data range
     findFeatRange();
+    findBinaryFeatures();
 
-    cout << "Loaded " << m_numSamples << " samples with " << m_numFeatures;
+    cout << "Loaded " << m_numSamples << ((m_isBinary) ? " binary" : "") << " samples with " << m_numFeatures;
     cout << " features and " << m_numClasses << " classes." << endl;
 }
 
@@ -124,33 +433,11 @@ void DataSet::loadLIBSVM(string filename) {
     fp >> startIndex;
 
     // Reading the data
-    string line, tmpStr;
-    int prePos, curPos, colIndex;
     m_samples.clear();
 
     for (int i = 0; i < m_numSamples; i++) {
-        wsvector<double> x(m_numFeatures);
         Sample sample;
-        resize(sample.x, m_numFeatures);
-        fp >> sample.y; // read label
-        sample.w = 1.0; // set weight
-
-        getline(fp, line); // read the rest of the line
-        prePos = 0;
-        curPos = line.find(' ', 0);
-        while (prePos <= curPos) {
-            prePos = curPos + 1;
-            curPos = line.find(':', prePos);
-            tmpStr = line.substr(prePos, curPos - prePos);
-            colIndex = atoi(tmpStr.c_str()) - startIndex;
-
-            prePos = curPos + 1;
-            curPos = line.find(' ', prePos);
-            tmpStr = line.substr(prePos, curPos - prePos);
-	    string andi = tmpStr.c_str();
-            x[colIndex] = atof(tmpStr.c_str());
-        }
-        copy(x, sample.x);
+        readLIBSVMSample(fp, m_numFeatures, startIndex, sample);
         m_samples.push_back(sample); // push sample into dataset
     }
 
@@ -164,7 +451,146 @@ void DataSet::loadLIBSVM(string filename) {
 
     // Find the data range
     findFeatRange();
+    findBinaryFeatures();
 
-    cout << "Loaded " << m_numSamples << " samples with " << m_numFeatures;
+    cout << "Loaded " << m_numSamples << ((m_isBinary) ? " binary" : "") << " samples with " << m_numFeatures;
     cout << " features and " << m_numClasses << " classes." << endl;
 }
+
+ChunkedDataFile::ChunkedDataFile(string filename, const int &chunkSize) :
+    m_keepRawFeatures(true), m_filename(filename), m_chunkSize(chunkSize), m_isLIBSVM(true) {
+    m_fp.open(filename.c_str(), ios::binary);
+    if (!m_fp) {
+        cout << "Could not open input file " << filename << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    cout << "Scanning data file: " << filename << " ... " << endl;
+
+    // Reading the header
+    m_fp >> m_numSamples;
+    m_fp >> m_numFeatures;
+    m_fp >> m_numClasses;
+    m_fp >> m_startIndex;
+
+    scan();
+}
+
+ChunkedDataFile::ChunkedDataFile(string fileLabels, string fileData, const int &numSamples, const int &chunkSize) :
+    m_keepRawFeatures(true), m_filename(fileData), m_chunkSize(chunkSize), m_startIndex(0), m_isLIBSVM(false) {
+    m_fp.open(fileData.c_str());
+    m_labelsFp.open(fileLabels.c_str());
+    if (!m_labelsFp) {
+        cout << "Could not open input file " << fileLabels << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!m_fp) {
+        cout << "Could not open input file " << fileData << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    cout << "Scanning data file: " << fileData << ", " << fileLabels << " ... " << endl;
+
+    // Reading the headers of the labels and the data file
+    m_labelsFp >> m_numSamples;
+    m_labelsFp >> m_numFeatures;
+    m_fp >> m_numSamples;
+    m_fp >> m_numFeatures;
+
+    // not very nice, as in DataSet::loadRGBD
+    m_numClasses = 5;
+
+    m_numSamples = (numSamples > m_numSamples || numSamples == 0) ? m_numSamples : numSamples;
+
+    scan();
+}
+
+void ChunkedDataFile::readSample(Sample &sample) {
+    if (m_isLIBSVM) {
+        readLIBSVMSample(m_fp, m_numFeatures, m_startIndex, sample);
+    } else {
+        readRGBDSample(m_fp, m_labelsFp, m_numFeatures, sample);
+    }
+}
+
+void ChunkedDataFile::scan() {
+    // One sequential pass for the chunk offsets, the feature range and the binary check. The
+    // features missing from a sparse sample count as 0, as in DataSet::findFeatRange.
+    vector<int> numNonZeros(m_numFeatures, 0);
+    m_minFeatRange.assign(m_numFeatures, 0.0);
+    m_maxFeatRange.assign(m_numFeatures, 0.0);
+    m_isBinary = true;
+
+    Sample sample;
+    for (int i = 0; i < m_numSamples; i++) {
+        if (i % m_chunkSize == 0) {
+            m_chunkOffsets.push_back(m_fp.tellg());
+            if (!m_isLIBSVM) {
+                m_labelOffsets.push_back(m_labelsFp.tellg());
+            }
+        }
+
+        readSample(sample);
+        if (!m_fp) {
+            cout << "Could not load " << m_numSamples << " samples from " << m_filename;
+            cout << ". There were only " << i << " samples!" << endl;
+            exit(EXIT_FAILURE);
+        }
+
+        for (SparseVector::const_iterator itr = sample.x.begin(); itr != sample.x.end(); ++itr) {
+            int index = itr.index();
+            if (!numNonZeros[index] || *itr < m_minFeatRange[index]) {
+                m_minFeatRange[index] = *itr;
+            }
+            if (!numNonZeros[index] || *itr > m_maxFeatRange[index]) {
+                m_maxFeatRange[index] = *itr;
+            }
+            numNonZeros[index]++;
+
+            if (*itr != 1.0) {
+                m_isBinary = false;
+            }
+        }
+    }
+
+    for (int i = 0; i < m_numFeatures; i++) {
+        if (numNonZeros[i] < m_numSamples) {
+            m_minFeatRange[i] = min(m_minFeatRange[i], 0.0);
+            m_maxFeatRange[i] = max(m_maxFeatRange[i], 0.0);
+        }
+    }
+
+    cout << "Found " << m_numSamples << ((m_isBinary) ? " binary" : "") << " samples with " << m_numFeatures;
+    cout << " features and " << m_numClasses << " classes in " << numChunks() << " chunks." << endl;
+}
+
+void ChunkedDataFile::getInfo(DataSet &dataset) const {
+    dataset.m_samples.clear();
+    dataset.m_numSamples = 0;
+    dataset.m_numFeatures = m_numFeatures;
+    dataset.m_numClasses = m_numClasses;
+    dataset.m_minFeatRange = m_minFeatRange;
+    dataset.m_maxFeatRange = m_maxFeatRange;
+    dataset.m_isBinary = m_isBinary;
+    dataset.m_keepRawFeatures = m_keepRawFeatures;
+}
+
+void ChunkedDataFile::readChunk(const int &chunk, vector<Sample> &samples) {
+    int numChunkSamples = min(m_chunkSize, m_numSamples - chunk * m_chunkSize);
+
+    m_fp.clear();
+    m_fp.seekg(m_chunkOffsets[chunk]);
+    if (!m_isLIBSVM) {
+        m_labelsFp.clear();
+        m_labelsFp.seekg(m_labelOffsets[chunk]);
+    }
+
+    // Keep the storage of the previous chunk
+    samples.resize(numChunkSamples);
+    for (int i = 0; i < numChunkSamples; i++) {
+        readSample(samples[i]);
+        if (m_isBinary) {
+            packBits(samples[i], m_numFeatures, m_keepRawFeatures);
+        }
+    }
+}
@@ -2,6 +2,7 @@
 #define DATA_H_
 
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <gmm/gmm.h>
 #include <string>
@@ -15,6 +16,7 @@ using namespace gmm;
 typedef int Label;
 typedef double Weight;
 typedef rsvector<double> SparseVector;
+typedef unsigned long long BitBlock;
 
 // DATA CLASSES
 class Sample {
@@ -22,6 +24,18 @@ class Sample {
     SparseVector x;
     Label y;
     Weight w;
+    vector<BitBlock> bits; // set features of a binary sample with many of them, empty otherwise
+    vector<int> ones; // sorted set features of a binary sample with few of them, empty otherwise
+    const float *dense; // row of DataSet::m_denseFeatures for dense binary files, NULL otherwise
+    const unsigned char *quant8; // row of DataSet::m_quant8 after 8 bit quantization, NULL otherwise
+    const unsigned short *quant16; // row of DataSet::m_quant16 after 16 bit quantization, NULL otherwise
+
+    Sample() : dense(NULL), quant8(NULL), quant16(NULL) {
+    }
+
+    bool hasBit(const int &index) const {
+	return (bits[index >> 6] >> (index & 63)) & 1;
+    }
 
     void disp() {
 	cout << "Sample: y = " << y << ", w = " << w << ", x = ";
@@ -33,7 +47,16 @@ class DataSet {
   private:
     void loadLIBSVM(string filename);
     void loadRGBD(string fileLabels, string fileData, int n_samples);
+    void loadDense(string filename, int n_samples);
   public:
+    DataSet() : m_keepRawFeatures(true) {
+    }
+
+    //! The samples point into the contiguous feature storage of the dataset, so a copy would
+    //! point into the original
+    DataSet(const DataSet &) = delete;
+    DataSet& operator=(const DataSet &) = delete;
+
     vector<Sample> m_samples;
     int m_numSamples;
     int m_numFeatures;
@@ -41,13 +64,111 @@ class DataSet {
 
     vector<double> m_minFeatRange;
     vector<double> m_maxFeatRange;
+    bool m_isBinary;
+
+    //! Without the raw features, the samples of a binary dataset only keep their set features,
+    //! and the rows of a dense binary file get no sparse copy; x has no entries then. Only the
+    //! trees of an ORT/ORF with majority leaves can do without them. Set before loading.
+    bool m_keepRawFeatures;
+
+    //! Contiguous row major features of a dense binary file, the samples point into it. Without
+    //! the raw features, x of the samples has no entries.
+    vector<float> m_denseFeatures;
+
+    //! Contiguous row major quantized features, see quantize()
+    vector<unsigned char> m_quant8;
+    vector<unsigned short> m_quant16;
 
     void findFeatRange();
+    void findBinaryFeatures();
+
+    //! Maps every feature linearly from [minFeatRange, maxFeatRange] (the ranges of the training
+    //! set) to the integers 0 .. 2^bits - 1, with bits 8 or 16. Values outside the range are
+    //! clamped. The quantized rows replace the sparse and dense copies of the features, so only
+    //! the trees of an ORT/ORF with majority leaves can use the dataset afterwards. The codes are
+    //! stored densely, so binary and sparse datasets for which they would take more memory than
+    //! the features are refused.
+    void quantize(const int &bits, const vector<double> &minFeatRange, const vector<double> &maxFeatRange);
+
+    //! Writes the dataset as a dense binary file: the magic "ORFD", then the number of rows,
+    //! columns and classes and the row labels as int32, then the row major float32 features,
+    //! all in native byte order. Files ending in ".bin" are loaded with one read.
+    void saveDense(string filename) const;
 
     void loadTrain(Hyperparameters hp);
     void loadTest(Hyperparameters hp);
 };
 
+//! Samples of a DataSet picked by their indices, e.g. a cross-validation fold. The samples
+//! are not copied, the view is only valid as long as the data set is.
+class DataSetView {
+  public:
+    explicit DataSetView(DataSet &dataset) : m_dataset(&dataset) {
+    }
+
+    Sample& operator[](const int &i) {
+	return m_dataset->m_samples[m_indices[i]];
+    }
+
+    int size() const {
+	return (int) m_indices.size();
+    }
+
+    DataSet *m_dataset;
+    vector<int> m_indices;
+};
+
+//! A LIBSVM or RGBD data file that is read in chunks of consecutive samples, so the training
+//! data does not have to fit in memory. The constructors scan the file once for the chunk
+//! offsets and the feature range.
+class ChunkedDataFile {
+  public:
+    ChunkedDataFile(string filename, const int &chunkSize);
+    ChunkedDataFile(string fileLabels, string fileData, const int &numSamples, const int &chunkSize);
+
+    int m_numSamples;
+    int m_numFeatures;
+    int m_numClasses;
+
+    vector<double> m_minFeatRange;
+    vector<double> m_maxFeatRange;
+    bool m_isBinary;
+    bool m_keepRawFeatures; // as DataSet::m_keepRawFeatures, true by default
+
+    int numChunks() const {
+	return m_chunkOffsets.size();
+    }
+
+    //! Copies the sizes and the feature range into a dataset without samples
+    void getInfo(DataSet &dataset) const;
+
+    //! Reads the samples of a chunk in file order, reusing the storage of samples
+    void readChunk(const int &chunk, vector<Sample> &samples);
+
+  private:
+    string m_filename;
+    ifstream m_fp;
+    int m_chunkSize;
+    int m_startIndex;
+    bool m_isLIBSVM;
+    ifstream m_labelsFp; // RGBD only
+    vector<streampos> m_chunkOffsets;
+    vector<streampos> m_labelOffsets;
+
+    void scan();
+    void readSample(Sample &sample);
+};
+
+//! Reads one "label index:value ..." line of a LIBSVM file
+void readLIBSVMSample(istream &fp, const int &numFeatures, const int &startIndex, Sample &sample);
+
+//! Reads the label and the dense feature line of an RGBD sample
+void readRGBDSample(istream &fData, istream &fLabels, const int &numFeatures, Sample &sample);
+
+//! Stores the set features of a sample whose non-zero values are all 1.0, as a bitset or as a
+//! sorted index list, whichever is smaller. Without keepRawFeatures, the entries of x are freed.
+void packBits(Sample &sample, const int &numFeatures, const bool &keepRawFeatures);
+
 class Result {
   public:
     vector<double> confidence;
@@ -0,0 +1,177 @@
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+
+#include "exporter.h"
+
+using namespace std;
+
+CodeExporter::CodeExporter(const Hyperparameters &hp, const int &numClasses, const int &numFeatures) :
+    m_hp(&hp), m_numClasses(numClasses), m_numFeatures(numFeatures) {
+}
+
+void CodeExporter::write(const OnlineRF &forest, const string &filename) {
+    vector<const OnlineNode*> roots;
+    for (int i = 0; i < (int) forest.m_trees.size(); i++) {
+        roots.push_back(forest.m_trees[i]->m_rootNode);
+    }
+    write(roots, m_hp->useSoftVoting, filename);
+}
+
+void CodeExporter::write(const OnlineTree &tree, const string &filename) {
+    // A single tree predicts the label of its leaf, which is what both voting modes give
+    vector<const OnlineNode*> roots(1, tree.m_rootNode);
+    write(roots, true, filename);
+}
+
+void CodeExporter::write(const vector<const OnlineNode*> &roots, const bool &useSoftVoting, const string &filename) {
+    ofstream out(filename.c_str());
+    if (!out) {
+        cout << "Could not open output file " << filename << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Weights and thresholds have to survive the round trip through the text exactly
+    out << setprecision(17);
+    m_leafDistributions.clear();
+    m_leafLabels.clear();
+
+    out << "// Generated by Online-Forest --export, do not edit." << endl;
+    out << "// Scores " << roots.size() << " trees with " << ((useSoftVoting) ? "soft" : "hard") << " voting." << endl;
+    out << endl;
+    out << "extern const int orf_num_features = " << m_numFeatures << ";" << endl;
+    out << "extern const int orf_num_classes = " << m_numClasses << ";" << endl;
+    out << endl;
+
+    for (int t = 0; t < (int) roots.size(); t++) {
+        out << "static int orf_tree_" << t << "(const double *x) {" << endl;
+        writeNode(out, roots[t], 1);
+        out << "}" << endl << endl;
+    }
+
+    out << "static const double orf_leaf_distributions[" << m_leafLabels.size() << "][" << m_numClasses << "] = {" << endl;
+    for (int l = 0; l < (int) m_leafLabels.size(); l++) {
+        out << "    { ";
+        for (int c = 0; c < m_numClasses; c++) {
+            out << m_leafDistributions[l][c] << ((c + 1 < m_numClasses) ? ", " : " ");
+        }
+        out << "}," << endl;
+    }
+    out << "};" << endl << endl;
+
+    out << "static const int orf_leaf_labels[" << m_leafLabels.size() << "] = {";
+    for (int l = 0; l < (int) m_leafLabels.size(); l++) {
+        out << ((l % 20) ? " " : "\n    ") << m_leafLabels[l] << ",";
+    }
+    out << endl << "};" << endl << endl;
+
+    out << "static int (*const orf_trees[" << roots.size() << "])(const double *) = {";
+    for (int t = 0; t < (int) roots.size(); t++) {
+        out << ((t % 8) ? " " : "\n    ") << "orf_tree_" << t << ",";
+    }
+    out << endl << "};" << endl << endl;
+
+    // Same summation order and normalization as OnlineRF::eval, so the results are identical
+    out << "int orf_predict(const double *x, double *confidence) {" << endl;
+    out << "    for (int c = 0; c < " << m_numClasses << "; c++) {" << endl;
+    out << "        confidence[c] = 0.0;" << endl;
+    out << "    }" << endl;
+    out << "    for (int t = 0; t < " << roots.size() << "; t++) {" << endl;
+    out << "        int leaf = orf_trees[t](x);" << endl;
+    if (useSoftVoting) {
+        out << "        for (int c = 0; c < " << m_numClasses << "; c++) {" << endl;
+        out << "            confidence[c] += orf_leaf_distributions[leaf][c];" << endl;
+        out << "        }" << endl;
+    } else {
+        out << "        confidence[orf_leaf_labels[leaf]]++;" << endl;
+    }
+    out << "    }" << endl;
+    out << "    int prediction = 0;" << endl;
+    out << "    for (int c = 0; c < " << m_numClasses << "; c++) {" << endl;
+    out << "        confidence[c] *= 1.0 / " << roots.size() << ";" << endl;
+    out << "        if (confidence[c] > confidence[prediction]) {" << endl;
+    out << "            prediction = c;" << endl;
+    out << "        }" << endl;
+    out << "    }" << endl;
+    out << "    return prediction;" << endl;
+    out << "}" << endl;
+
+    cout << "Exported " << roots.size() << " trees with " << m_leafLabels.size() << " leaves to " << filename << endl;
+}
+
+void CodeExporter::writeNode(ostream &out, const OnlineNode *node, const int &indent) {
+    string pad(4 * indent, ' ');
+
+    if (node->m_isLeaf) {
+        // The distribution and prediction of OnlineNode::eval with a weight of 1
+        vector<double> distribution(m_numClasses, 1.0 / m_numClasses);
+        int label = 0;
+        if (node->m_counter + node->m_parentCounter) {
+            double norm = 1.0 / (node->m_counter + node->m_parentCounter);
+            for (int c = 0; c < m_numClasses; c++) {
+                distribution[c] = norm * node->m_labelStats[c];
+            }
+            label = node->m_label;
+        }
+
+        out << pad << "return " << m_leafLabels.size() << ";" << endl;
+        m_leafDistributions.push_back(distribution);
+        m_leafLabels.push_back(label);
+        return;
+    }
+
+    const HyperplaneFeature &test = node->m_bestTest;
+    out << pad << "if (";
+    for (int i = 0; i < (int) test.m_weights.size(); i++) {
+        out << ((i) ? " + " : "") << "x[" << test.m_features[i] << "] * " << test.m_weights[i];
+    }
+    out << " > " << test.m_threshold << ") {" << endl;
+    writeNode(out, node->m_rightChildNode, indent + 1);
+    out << pad << "} else {" << endl;
+    writeNode(out, node->m_leftChildNode, indent + 1);
+    out << pad << "}" << endl;
+}
+
+void CodeExporter::writeCheckFile(OnlineRF &forest, DataSet &dataset, const string &filename) {
+    vector<int> predictions;
+    for (int n = 0; n < dataset.m_numSamples; n++) {
+        predictions.push_back(forest.evalAllTrees(dataset.m_samples[n]).prediction);
+    }
+    writeCheckFile(predictions, dataset, filename);
+}
+
+void CodeExporter::writeCheckFile(OnlineTree &tree, DataSet &dataset, const string &filename) {
+    vector<int> predictions;
+    for (int n = 0; n < dataset.m_numSamples; n++) {
+        predictions.push_back(tree.eval(dataset.m_samples[n]).prediction);
+    }
+    writeCheckFile(predictions, dataset, filename);
+}
+
+void CodeExporter::writeCheckFile(const vector<int> &predictions, DataSet &dataset, const string &filename) {
+    ofstream out(filename.c_str());
+    if (!out) {
+        cout << "Could not open output file " << filename << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // One line per sample: the prediction of the model, then all features
+    out << setprecision(17);
+    out << dataset.m_numSamples << " " << dataset.m_numFeatures << endl;
+    vector<double> x(dataset.m_numFeatures);
+    for (int n = 0; n < dataset.m_numSamples; n++) {
+        Sample &sample = dataset.m_samples[n];
+        x.assign(dataset.m_numFeatures, 0.0);
+        for (SparseVector::const_iterator itr = sample.x.begin(); itr != sample.x.end(); ++itr) {
+            x[itr.index()] = *itr;
+        }
+
+        out << predictions[n];
+        for (int i = 0; i < dataset.m_numFeatures; i++) {
+            out << " " << x[i];
+        }
+        out << endl;
+    }
+
+    cout << "Wrote " << dataset.m_numSamples << " reference predictions to " << filename << endl;
+}
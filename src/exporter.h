@@ -0,0 +1,53 @@
+#ifndef EXPORTER_H_
+#define EXPORTER_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "classifier.h"
+#include "data.h"
+#include "onlinenode.h"
+#include "onlinerf.h"
+#include "onlinetree.h"
+
+using namespace std;
+
+//! Writes a trained tree or forest as a self-contained C++ source file. Every tree becomes a
+//! function of nested comparisons with the projection weights and thresholds inlined, and the
+//! leaves index static tables with their class distributions and labels. The generated file
+//! provides
+//!
+//!     extern const int orf_num_features, orf_num_classes;
+//!     int orf_predict(const double *x, double *confidence);
+//!
+//! where x holds all features densely. Only models with majority vote leaves can be exported,
+//! and the projections use the raw (not quantized) features.
+class CodeExporter {
+public:
+    CodeExporter(const Hyperparameters &hp, const int &numClasses, const int &numFeatures);
+
+    void write(const OnlineRF &forest, const string &filename);
+    void write(const OnlineTree &tree, const string &filename);
+
+    //! Writes the dense features of a dataset together with the predictions of the model, for
+    //! checking a generated scorer against it. The forest evaluates all of its trees in index
+    //! order, as the scorer does, whatever its early exit settings are.
+    static void writeCheckFile(OnlineRF &forest, DataSet &dataset, const string &filename);
+    static void writeCheckFile(OnlineTree &tree, DataSet &dataset, const string &filename);
+
+private:
+    const Hyperparameters *m_hp;
+    int m_numClasses;
+    int m_numFeatures;
+
+    // Leaf tables, filled while writing the trees
+    vector<vector<double> > m_leafDistributions;
+    vector<int> m_leafLabels;
+
+    void write(const vector<const OnlineNode*> &roots, const bool &useSoftVoting, const string &filename);
+    void writeNode(ostream &out, const OnlineNode *node, const int &indent);
+    static void writeCheckFile(const vector<int> &predictions, DataSet &dataset, const string &filename);
+};
+
+#endif /* EXPORTER_H_ */
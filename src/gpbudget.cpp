@@ -0,0 +1,49 @@
+#include "gpbudget.h"
+#include "onlinenode.h"
+
+using namespace std;
+
+void GPLeafBudget::touch(OnlineNode *node, const long &numBytes) {
+    map<OnlineNode*, list<Entry>::iterator>::iterator itr = m_index.find(node);
+    if (itr != m_index.end()) {
+        m_numBytes -= itr->second->numBytes;
+        m_leaves.erase(itr->second);
+    }
+
+    Entry entry;
+    entry.node = node;
+    entry.numBytes = numBytes;
+    m_leaves.push_front(entry);
+    m_index[node] = m_leaves.begin();
+    m_numBytes += numBytes;
+
+    // Evict from the back, but never the leaf that is being updated
+    while (isOverBudget() && m_leaves.size() > 1) {
+        OnlineNode *evicted = m_leaves.back().node;
+        remove(evicted);
+        evicted->evictGP();
+        m_numEvictions++;
+    }
+}
+
+void GPLeafBudget::remove(OnlineNode *node) {
+    map<OnlineNode*, list<Entry>::iterator>::iterator itr = m_index.find(node);
+    if (itr == m_index.end()) {
+        return;
+    }
+
+    m_numBytes -= itr->second->numBytes;
+    m_leaves.erase(itr->second);
+    m_index.erase(itr);
+}
+
+bool GPLeafBudget::isOverBudget() const {
+    if (m_hp->maxGPLeaves && (int) m_leaves.size() > m_hp->maxGPLeaves) {
+        return true;
+    }
+    if (m_hp->maxGPMemory && m_numBytes > (long) m_hp->maxGPMemory * 1024 * 1024) {
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,57 @@
+#ifndef GPBUDGET_H_
+#define GPBUDGET_H_
+
+#include <list>
+#include <map>
+
+#include "hyperparameters.h"
+
+using namespace std;
+
+class OnlineNode;
+
+//! Limits the number and the memory of the GP leaves of a whole forest. GP leaves are
+//! ordered by their last update, the least recently updated ones are evicted first.
+class GPLeafBudget {
+public:
+    GPLeafBudget(const Hyperparameters &hp) :
+        m_hp(&hp), m_numBytes(0), m_numEvictions(0) {
+    }
+
+    //! Registers a new GP leaf or marks it as the most recently used one with its current
+    //! memory usage, then evicts other leaves until the budget is met
+    void touch(OnlineNode *node, const long &numBytes);
+
+    //! Unregisters a leaf whose GP has been deleted by the leaf itself
+    void remove(OnlineNode *node);
+
+    int numLeaves() const {
+        return (int) m_leaves.size();
+    }
+
+    long numBytes() const {
+        return m_numBytes;
+    }
+
+    int numEvictions() const {
+        return m_numEvictions;
+    }
+
+private:
+    struct Entry {
+        OnlineNode *node;
+        long numBytes;
+    };
+
+    const Hyperparameters *m_hp;
+
+    // Most recently used first
+    list<Entry> m_leaves;
+    map<OnlineNode*, list<Entry>::iterator> m_index;
+    long m_numBytes;
+    int m_numEvictions;
+
+    bool isOverBudget() const;
+};
+
+#endif /* GPBUDGET_H_ */
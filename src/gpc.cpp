@@ -2,26 +2,21 @@
 
 #include <gp-lvm/CMatrix.h>
 
-// for 'rsvector_dense_iterator'
-#include "rsvector_dense_iterator.h"
-
 // for choosing the two most often occurring labels
 #include <map>
+#include <algorithm>
 
-typedef rsvector_dense_iterator feature_it;
-typedef rsvector_const_dense_iterator const_feature_it;
-
-
-vector<double>& to_dense_vector(const SparseVector& sv) {
-	vector<double>* result = new vector<double>;
 
-	int fi = 0;
-
-	for(const_feature_it iter=const_feature_it(sv.begin()); fi<sv.size(); fi++, iter++) {
-		result->push_back(*iter);
+void set_dense_row(CMatrix& mat, unsigned int row, const SparseVector& sv) {
+	for(SparseVector::const_iterator it=sv.begin(); it != sv.end(); it++) {
+		mat.setVal(*it, row, it.index());
 	}
+}
 
-	return *result;
+void clear_dense_row(CMatrix& mat, unsigned int row, const SparseVector& sv) {
+	for(SparseVector::const_iterator it=sv.begin(); it != sv.end(); it++) {
+		mat.setVal(0.0, row, it.index());
+	}
 }
 
 /**
@@ -102,13 +97,83 @@ void GPC::choose_labels_from_buffer() {
 */
 
 bool GPC::is_pure() {
-	return (label_counter->size() < 2);
+	return (n_positive == 0 || n_negative == 0);
 }
 
 
-GPC::GPC(int n_features, int active_set_size, unsigned int max_iters, unsigned int kern_iters, unsigned int noise_iters) {
+void SampleBuffer::discard_before(long index) {
+	while(first_index < index && !samples.empty()) {
+		n_bytes -= sample_bytes(samples.front());
+		samples.pop_front();
+		first_index++;
+	}
+}
+
+
+GPCTrainingJob::GPCTrainingJob() {
+	training_labels = (CMatrix*) NULL;
+	training_features = (CMatrix*) NULL;
+	training_table = (SparseSampleTable*) NULL;
+	kernel = (CKern*) NULL;
+	noise_params = (CMatrix*) NULL;
+
+	noise = (CNoise*) NULL;
+	predictor = (CIvm*) NULL;
+
+	n_new_samples = 0;
+}
+
+double GPCTrainingJob::priority() const {
+	double staleness = std::chrono::duration<double>(Clock::now() - model_time).count();
+	return n_new_samples * (1.0 + staleness);
+}
+
+/**
+ * Fit the IVM. This runs on a worker thread and only touches the job's own objects.
+ */
+void GPCTrainingJob::run() {
+	noise = new CProbitNoise( training_labels );
+	if(noise_params != NULL) {
+		// warm start the noise model from the previous cycle
+		noise->setParams( *noise_params );
+	}
+
+	predictor = new CIvm(training_features, training_labels, kernel, noise, select_crit, active_set_size, 3);
+
+	if(default_optimization_params)
+		predictor->optimise();
+	else
+		predictor->optimise(max_iters, kern_iters, noise_iters);
+}
+
+
+GPC::GPC(int n_features, int active_set_size, unsigned int max_iters, unsigned int kern_iters, unsigned int noise_iters,
+		 bool sparse_kernel, int max_batch_size) :
+	feature_mat(1, n_features), prob_mat(1, 1), result_mat(1, 1), query_mat(1, 1) {
+	init(n_features, active_set_size, max_iters, kern_iters, noise_iters, sparse_kernel, max_batch_size);
+
+	samples = new SampleBuffer();
+	owns_samples = true;
+	positive_label = 1;
+}
+
+GPC::GPC(SampleBuffer* samples, Label positive_label, int n_features, int active_set_size, unsigned int max_iters,
+		 unsigned int kern_iters, unsigned int noise_iters, bool sparse_kernel, int max_batch_size) :
+	feature_mat(1, n_features), prob_mat(1, 1), result_mat(1, 1), query_mat(1, 1) {
+	init(n_features, active_set_size, max_iters, kern_iters, noise_iters, sparse_kernel, max_batch_size);
+
+	this->samples = samples;
+	owns_samples = false;
+	this->positive_label = positive_label;
+	window_start = samples->end_index();
+}
+
+void GPC::init(int n_features, int active_set_size, unsigned int max_iters, unsigned int kern_iters, unsigned int noise_iters,
+			   bool sparse_kernel, int max_batch_size) {
 	state = TRAIN;
 	input_dim = n_features;
+	this->sparse_kernel = sparse_kernel;
+	this->max_batch_size = max_batch_size;
 
 	this->active_set_size = active_set_size;
 	this->max_iters = max_iters;
@@ -118,47 +183,178 @@ GPC::GPC(int n_features, int active_set_size, unsigned int max_iters, unsigned i
 
 	select_crit = CIvm::ENTROPY;
 
-	buffered_samples = new std::vector<Sample>();
-	label_counter = new std::map<Label,int>();
+	window_start = 0;
+	n_positive = 0;
+	n_negative = 0;
 
 	// noise will be initialized in the training routine
 	// s.t. the target can be set
 	noise = (CNoise*) NULL;
-	kernel = new CRbfKern( input_dim );
+	kernel = new_kernel(NULL, NULL);
+
+	predictor = (CIvm*) NULL;
+	training_labels = (CMatrix*) NULL;
+	training_features = (CMatrix*) NULL;
+	training_table = (SparseSampleTable*) NULL;
+	training_job = (GPCTrainingJob*) NULL;
+	model_time = Clock::now();
+}
+
+GPC::~GPC() {
+	if(training_job != NULL) {
+		// collect the job's results, so they can be freed with the model
+		if(WorkerPool::instance().cancel(training_job))
+			training_job->finish();
+		else
+			training_job->wait();
+		publish_trained_model();
+	}
+
+	delete_model();
+	delete kernel;
+	if(owns_samples)
+		delete samples;
+}
+
+/**
+ * Create a new RBF kernel with the gamma prior on its variance.
+ *
+ * @param params_from kernel to copy the parameters from, or NULL for the defaults
+ * @param table the sparse samples the kernel is evaluated on, only for the sparse kernel
+ */
+CKern* GPC::new_kernel(const CKern* params_from, const SparseSampleTable* table) {
+	CKern* result;
+	if(sparse_kernel)
+		result = new CSparseRbfKern( table );
+	else
+		result = new CRbfKern( input_dim );
 
 	CDist* prior = new CGammaDist();
 	prior->setParam(1.0, 0);
 	prior->setParam(1.0, 1);
 
-	kernel->addPrior(prior,1);
+	result->addPrior(prior,1);
 
-	predictor = (CIvm*) NULL;
+	if(params_from != NULL) {
+		for(unsigned int i=0; i<params_from->getNumParams(); i++) {
+			result->setParam(params_from->getParam(i), i);
+		}
+	}
+
+	return result;
 }
 
 
-void GPC::get_training_matrices(CMatrix*& training_labels, CMatrix*& training_features) {
+/**
+ * Build the training matrices for the next retrain.
+ *
+ * The training set is warm started with the active set of the current
+ * predictor, followed by the most recent samples of the window, so the
+ * IVM selects its new active set from the old active points and the new
+ * data. With max_batch_size the cost of a retrain is bounded, see select_batch().
+ *
+ * The labels are the +1/-1 view for 'positive_label'. For the dense kernel, the
+ * feature matrix starts out zero, so only the non-zero entries of the sparse
+ * samples are written. For the sparse kernel, the samples are copied into a
+ * table and the feature matrix holds their row ids.
+ */
+void GPC::get_training_matrices(CMatrix*& training_labels, CMatrix*& training_features, SparseSampleTable*& training_table) {
+
+	int n_active = (predictor != NULL) ? predictor->getActiveSetSize() : 0;
+
+	std::vector<long> batch;
+	select_batch(batch);
 
-	int n_samples = (*label_counter)[1] + (*label_counter)[-1];
+	int n_samples = n_active + (int) batch.size();
 
 	training_labels = new CMatrix(n_samples, 1);
-	training_features = new CMatrix(n_samples, input_dim);
+	if(sparse_kernel) {
+		training_features = new CMatrix(n_samples, 1);
+		training_table = new SparseSampleTable();
+	}
+	else {
+		training_features = new CMatrix(n_samples, input_dim, 0.0);
+		training_table = (SparseSampleTable*) NULL;
+	}
 
 	int row = 0;
 
-	for(std::vector<Sample>::iterator it=buffered_samples->begin(); it != buffered_samples->end(); it++) {
-		if(it->y != 1 && it->y != -1)
-			continue;
+	// the active set of the current predictor
+	for(int i=0; i < n_active; i++, row++) {
+		unsigned int active_row = predictor->getActivePoint(i);
+
+		training_labels->setVal(this->training_labels->getVal(active_row, 0), row, 0);
+		if(sparse_kernel) {
+			unsigned int id = (unsigned int) this->training_features->getVal(active_row, 0);
+			training_features->setVal(training_table->add(this->training_table->get(id)), row, 0);
+		}
+		else {
+			for(int col=0; col < input_dim; col++) {
+				training_features->setVal(this->training_features->getVal(active_row, col), row, col);
+			}
+		}
+	}
+
+	// the new samples
+	for(unsigned int i=0; i < batch.size(); i++, row++) {
+		const Sample& s = samples->at(batch[i]);
 
-		training_labels->setVal(it->y, row, 0);
+		training_labels->setVal((s.y == positive_label) ? 1.0 : -1.0, row, 0);
+		if(sparse_kernel)
+			training_features->setVal(training_table->add(s.x), row, 0);
+		else
+			set_dense_row(*training_features, row, s.x);
+	}
+}
 
-		int col = 0;
 
-		for(feature_it ft=feature_it(it->x.begin()); col < input_dim; ft++, col++) {
-			training_features->setVal(*ft, row, col);
-		}
+/**
+ * Append 'n' of the buffer indices in 'from' to 'batch', evenly spaced over
+ * all of them and starting with the newest.
+ */
+static void take_evenly(const std::vector<long>& from, int n, std::vector<long>& batch) {
+	n = std::min(n, (int) from.size());
+	for(int k=0; k < n; k++)
+		batch.push_back(from[from.size() - 1 - (long) k * from.size() / n]);
+}
+
+/**
+ * Choose the window samples of the next training, in buffer order.
+ *
+ * Without max_batch_size, or if the window is not larger, that is the whole
+ * window. Otherwise the positive and the negative samples are subsampled
+ * separately, in proportion to their counts in the window and evenly over
+ * its whole length. Older samples are thus still seen by the IVM, and the
+ * batch has both labels whenever the window has, i.e. whenever is_pure()
+ * let the training start.
+ */
+void GPC::select_batch(std::vector<long>& batch) {
+	batch.clear();
+
+	long n_window = samples->end_index() - window_start;
+	if(max_batch_size <= 0 || n_window <= max_batch_size) {
+		for(long i=window_start; i < samples->end_index(); i++)
+			batch.push_back(i);
+		return;
+	}
 
-		row++;
+	std::vector<long> positives, negatives;
+	for(long i=window_start; i < samples->end_index(); i++) {
+		if(samples->at(i).y == positive_label)
+			positives.push_back(i);
+		else
+			negatives.push_back(i);
 	}
+
+	int n_take_positive = (int) ((double) max_batch_size * positives.size() / n_window + 0.5);
+	if(!positives.empty())
+		n_take_positive = std::max(n_take_positive, 1);
+	if(!negatives.empty())
+		n_take_positive = std::min(n_take_positive, max_batch_size - 1);
+
+	take_evenly(positives, n_take_positive, batch);
+	take_evenly(negatives, max_batch_size - n_take_positive, batch);
+	std::sort(batch.begin(), batch.end());
 }
 
 
@@ -178,16 +374,26 @@ void GPC::get_training_matrices(CMatrix*& training_labels, CMatrix*& training_fe
  * @param s the sample to be trained
  */
 void GPC::update(const Sample& s) {
+	samples->push_back(s);
+	update_from_buffer();
 
-	buffered_samples->push_back(s);
+	// nobody else reads the private buffer
+	samples->discard_before(window_start);
+}
 
-	// update the label counter
-	if(label_counter->find(s.y) == label_counter->end()) {
-		label_counter->insert(std::map<Label,int>::value_type(s.y,1));
-	} else {
-		(*label_counter)[s.y]++;
-	}
+/**
+ * Account for the newest sample in the (shared) sample buffer.
+ */
+void GPC::update_from_buffer() {
 
+	// swap in a predictor that finished training in the background
+	publish_trained_model();
+
+	// update the label counter
+	if(samples->at(samples->end_index() - 1).y == positive_label)
+		n_positive++;
+	else
+		n_negative++;
 
 	switch(state) {
 /*
@@ -200,70 +406,183 @@ void GPC::update(const Sample& s) {
 		break;
 */
 	case TRAIN:
-		// check if we have collected enough data to initiate training
-		if(!is_pure() && (*label_counter)[1] + (*label_counter)[-1] > active_set_size) {
-
-			// copy the relevant samples into a matrix
-			CMatrix* training_labels;
-			CMatrix* training_features;
-			get_training_matrices(training_labels, training_features);
-
-			// is this the first learning cycle?
-			if(predictor == NULL) {
-				// no noise model existing yet => create new noise model
-				noise = new CProbitNoise( training_labels );
-			}
-			else {
-				// noise model is already existing => adapt model
-				CMatrix noiseParams(1, noise->getNumParams());
-				noise->getParams( noiseParams );
-				noise->setTarget( training_labels );
-				noise->setParams( noiseParams );
-			}
+		// check if we have collected enough data to initiate training;
+		// while a training is running, the samples keep being buffered for the next one
+		if(training_job == NULL && !is_pure() && n_positive + n_negative > active_set_size) {
+			start_training();
+		}
 
-			// update the gaussian process model
-			predictor = new CIvm(training_features, training_labels, kernel, noise, select_crit, active_set_size, 3);
+		break;
+	}
 
-			if(default_optimization_params)
-				predictor->optimise();
-			else
-				predictor->optimise(max_iters, kern_iters, noise_iters);
+}
 
-			// reset the counters for the labels
-			delete buffered_samples;
-			delete label_counter;
-			buffered_samples = new std::vector<Sample>();
-			label_counter = new std::map<Label,int>();
-		}
+/**
+ * Hand the buffered samples to a background training job.
+ *
+ * The job trains on a copy of the kernel and the noise parameters, the
+ * current predictor keeps serving until publish_trained_model() swaps
+ * in the result.
+ */
+void GPC::start_training() {
+	// the scheduler is saturated => keep buffering and try again with the next sample
+	if(WorkerPool::instance().isFull())
+		return;
 
-		break;
+	GPCTrainingJob* job = new GPCTrainingJob();
+
+	// copy the relevant samples into a matrix
+	get_training_matrices(job->training_labels, job->training_features, job->training_table);
+
+	job->kernel = new_kernel(kernel, job->training_table);
+	if(noise != NULL) {
+		// noise model is already existing => adapt model
+		job->noise_params = new CMatrix(1, noise->getNumParams());
+		noise->getParams( *job->noise_params );
 	}
 
+	job->select_crit = select_crit;
+	job->active_set_size = active_set_size;
+	job->default_optimization_params = default_optimization_params;
+	job->max_iters = max_iters;
+	job->kern_iters = kern_iters;
+	job->noise_iters = noise_iters;
+	job->n_new_samples = n_positive + n_negative;
+	job->model_time = model_time;
+
+	if(!WorkerPool::instance().submit(job)) {
+		job->finish();
+		training_job = job;
+		publish_trained_model();
+		return;
+	}
+
+	// start a new window and reset the counters for the labels
+	window_start = samples->end_index();
+	n_positive = 0;
+	n_negative = 0;
+
+	training_job = job;
+
+	// without workers the job has already run inline
+	publish_trained_model();
+}
+
+/**
+ * Replace the current predictor by the one of a finished training job.
+ *
+ * This only ever runs on the thread owning the GPC, so the predictor is
+ * never swapped while it is in use.
+ */
+void GPC::publish_trained_model() {
+	if(training_job == NULL || !training_job->isDone())
+		return;
+
+	GPCTrainingJob* job = training_job;
+	training_job = (GPCTrainingJob*) NULL;
+
+	if(job->predictor != NULL) {
+		delete_model();
+		delete kernel;
+
+		predictor = job->predictor;
+		noise = job->noise;
+		kernel = job->kernel;
+		training_labels = job->training_labels;
+		training_features = job->training_features;
+		training_table = job->training_table;
+		model_time = Clock::now();
+	}
+	else {
+		// the job was rejected or dropped before it could run
+		delete job->kernel;
+		delete job->training_labels;
+		delete job->training_features;
+		delete job->training_table;
+	}
+
+	delete job->noise_params;
+	delete job;
+}
+
+long GPC::memory_usage() const {
+	long n_bytes = sizeof(GPC) + feature_mat.getCols() * sizeof(double);
+
+	if(training_features != NULL) {
+		// training data plus the IVM's site parameters and its active set factors
+		n_bytes += training_features->getRows() * (training_features->getCols() + 1) * sizeof(double);
+		n_bytes += (long) active_set_size * (active_set_size + input_dim + training_features->getRows()) * sizeof(double);
+	}
+
+	if(training_table != NULL)
+		n_bytes += training_table->memory_usage();
+
+	if(owns_samples)
+		n_bytes += samples->memory_usage();
+
+	return n_bytes;
+}
+
+void GPC::delete_model() {
+	delete predictor;
+	delete noise;
+	delete training_labels;
+	delete training_features;
+	delete training_table;
+
+	predictor = (CIvm*) NULL;
+	noise = (CNoise*) NULL;
+	training_labels = (CMatrix*) NULL;
+	training_features = (CMatrix*) NULL;
+	training_table = (SparseSampleTable*) NULL;
 }
 
 Label GPC::predict(const SparseVector& features) {
-	vector<double> feature_vec = to_dense_vector(features);
+	publish_trained_model();
 
 	if(predictor != NULL) {
-		CMatrix ft(1, input_dim, feature_vec);
-		CMatrix pred(1,1);
-
-		predictor->out(pred, ft);
+		if(sparse_kernel) {
+			query_mat.setVal(training_table->set_query(0, features), 0, 0);
+			predictor->out(result_mat, query_mat);
+		}
+		else {
+			set_dense_row(feature_mat, 0, features);
+			predictor->out(result_mat, feature_mat);
+			clear_dense_row(feature_mat, 0, features);
+		}
 
-		return pred.getVal(0,0);
+		return result_mat.getVal(0,0);
 	}
 	return 0;
 }
 
 double GPC::likelihood(const SparseVector& features) {
-	vector<double> feature_vec = to_dense_vector(features);
+	publish_trained_model();
+
+	if(predictor != NULL) {
+		if(sparse_kernel) {
+			query_mat.setVal(training_table->set_query(0, features), 0, 0);
+			return likelihood(query_mat);
+		}
+
+		set_dense_row(feature_mat, 0, features);
+		double result = likelihood(feature_mat);
+		clear_dense_row(feature_mat, 0, features);
+
+		return result;
+	}
+	else {
+		// no valid prediction possible => no likelihood!
+		return 0;
+	}
+
+}
 
-	CMatrix prob_mat(1,1);
-	CMatrix result_mat(1,1);
-	CMatrix feature_mat(1, input_dim, feature_vec);
+double GPC::likelihood(const CMatrix& features) {
+	publish_trained_model();
 
 	if(predictor != NULL) {
-		predictor->out(result_mat, prob_mat, feature_mat);
+		predictor->out(result_mat, prob_mat, features);
 
 		return (((int) result_mat.getVal(0,0)) == 1) ? prob_mat.getVal(0,0) : 1 - prob_mat.getVal(0,0);
 	}
@@ -271,6 +590,64 @@ double GPC::likelihood(const SparseVector& features) {
 		// no valid prediction possible => no likelihood!
 		return 0;
 	}
+}
+
+/**
+ * Compute the likelihoods for a whole batch of samples.
+ *
+ * All rows are passed to the IVM at once, so the kernel between the active set and the
+ * batch is computed with matrix-matrix operations instead of one row at a time.
+ *
+ * @param features the n x input_dim matrix of samples
+ * @param likelihoods the n x k matrix receiving the likelihoods
+ * @param col the column of 'likelihoods' to write
+ */
+void GPC::likelihood(const CMatrix& features, CMatrix& likelihoods, unsigned int col) {
+	unsigned int n_samples = features.getRows();
+
+	publish_trained_model();
+
+	if(predictor == NULL) {
+		// no valid prediction possible => no likelihood!
+		for(unsigned int i=0; i<n_samples; i++) {
+			likelihoods.setVal(0.0, i, col);
+		}
+		return;
+	}
+
+	if(batch_result_mat.getRows() != n_samples) {
+		batch_result_mat.resize(n_samples, 1);
+		batch_prob_mat.resize(n_samples, 1);
+	}
 
+	predictor->out(batch_result_mat, batch_prob_mat, features);
+
+	for(unsigned int i=0; i<n_samples; i++) {
+		double prob = batch_prob_mat.getVal(i,0);
+		likelihoods.setVal((((int) batch_result_mat.getVal(i,0)) == 1) ? prob : 1 - prob, i, col);
+	}
 }
 
+/**
+ * Compute the likelihoods for a batch of sparse samples with the sparse kernel.
+ *
+ * @param batch the samples
+ * @param start the first sample of the batch
+ * @param n the number of samples in the batch
+ * @param likelihoods the n x k matrix receiving the likelihoods
+ * @param col the column of 'likelihoods' to write
+ */
+void GPC::likelihood(const std::vector<Sample>& batch, int start, int n, CMatrix& likelihoods, unsigned int col) {
+	publish_trained_model();
+
+	if(batch_query_mat.getRows() != (unsigned int) n)
+		batch_query_mat.resize(n, 1);
+
+	if(predictor != NULL) {
+		for(int i=0; i<n; i++) {
+			batch_query_mat.setVal(training_table->set_query(i, batch[start + i].x), i, 0);
+		}
+	}
+
+	likelihood(batch_query_mat, likelihoods, col);
+}
@@ -2,27 +2,123 @@
 #define GPC_HPP
 
 #include "data.h"
+#include "workerpool.h"
+#include "sparsekern.h"
 
 #include <gp-lvm/CKern.h>
 #include <gp-lvm/CNoise.h>
 #include <gp-lvm/CIvm.h>
+#include <gp-lvm/CMatrix.h>
 
+#include <deque>
 #include <vector>
 
 
+/**
+ * Samples shared by all one-vs-rest classifiers of an MGPC.
+ *
+ * Every sample is stored once. Samples are addressed by an absolute index
+ * that stays valid when older samples are discarded.
+ */
+class SampleBuffer {
+public:
+	SampleBuffer() : first_index(0), n_bytes(0) {}
+
+	void push_back(const Sample& s) { samples.push_back(s); n_bytes += sample_bytes(s); }
+	const Sample& at(long index) const { return samples[index - first_index]; }
+
+	long begin_index() const { return first_index; }
+	long end_index() const { return first_index + samples.size(); }
+
+	// drop the samples before 'index', once no classifier needs them anymore
+	void discard_before(long index);
+
+	// approximate memory used by the buffered samples
+	long memory_usage() const { return n_bytes; }
+private:
+	std::deque<Sample> samples;
+	long first_index;
+	long n_bytes;
+
+	static long sample_bytes(const Sample& s) { return sizeof(Sample) + s.x.nb_stored() * sizeof(elt_rsvector_<double>); }
+};
+
+
 typedef enum {
 	INIT,
 	TRAIN
 } gpc_state;
 
 
-class GPC {
+/**
+ * Trains a new IVM on a private copy of the kernel and noise model, so the
+ * predictor currently in use can keep serving while the job is running.
+ */
+class GPCTrainingJob: public Job {
 public:
-	GPC(int n_features, int active_set_size=20, unsigned int max_iters=0, unsigned int kern_iters=0, unsigned int noise_iters=0);
+	GPCTrainingJob();
+
+	virtual void run();
+
+	// leaves with more new samples and older models are trained first
+	virtual double priority() const;
+
+	// inputs, owned by the job until they are handed over to the GPC
+	CMatrix* training_labels;
+	CMatrix* training_features;
+	SparseSampleTable* training_table;
+	CKern* kernel;
+	CMatrix* noise_params;
+
+	int select_crit;
+	int active_set_size;
+	bool default_optimization_params;
+	unsigned int max_iters;
+	unsigned int kern_iters;
+	unsigned int noise_iters;
+
+	// traffic and staleness of the GPC, for the priority
+	int n_new_samples;
+	Clock::time_point model_time;
+
+	// outputs, NULL if the job was dropped before running
+	CNoise* noise;
+	CIvm* predictor;
+};
+
 
+class GPC {
+public:
+	GPC(int n_features, int active_set_size=20, unsigned int max_iters=0, unsigned int kern_iters=0, unsigned int noise_iters=0,
+		bool sparse_kernel=false, int max_batch_size=0);
+	// a one-vs-rest classifier for 'positive_label' on a buffer shared with other classifiers
+	GPC(SampleBuffer* samples, Label positive_label, int n_features, int active_set_size=20, unsigned int max_iters=0,
+		unsigned int kern_iters=0, unsigned int noise_iters=0, bool sparse_kernel=false, int max_batch_size=0);
+	~GPC();
+
+	// buffer a sample labelled 1 or -1 (only for a GPC with its own buffer)
 	void update(const Sample& s);
+	// account for the sample that was last appended to the shared buffer
+	void update_from_buffer();
+	// the oldest buffered sample this classifier still needs
+	long get_window_start() const { return window_start; }
+
+	// approximate memory of the model and the training data, without a shared sample buffer
+	long memory_usage() const;
+
 	Label predict(const SparseVector& features);
 	double likelihood(const SparseVector& features);
+
+	// likelihood of a sample already written to a dense 1 x input_dim matrix
+	// (or to a 1 x 1 row id matrix with the sparse kernel)
+	double likelihood(const CMatrix& feature_mat);
+	// likelihoods of all rows of a dense n x input_dim matrix (or n x 1 row ids with
+	// the sparse kernel), written to column 'col' of 'likelihoods'
+	void likelihood(const CMatrix& features, CMatrix& likelihoods, unsigned int col);
+	// likelihoods of 'n' samples starting at 'start', written to column 'col' of 'likelihoods' (sparse kernel only)
+	void likelihood(const std::vector<Sample>& batch, int start, int n, CMatrix& likelihoods, unsigned int col);
+
+	bool is_sparse() const { return sparse_kernel; }
 private:
 	gpc_state state;
 
@@ -34,26 +130,64 @@ private:
 	int active_set_size;
 	int select_crit;
 
+	// window samples used per retrain in addition to the previous active set, 0 = all
+	int max_batch_size;
+
 	CKern* kernel;
 	CNoise* noise;
 	CIvm* predictor;
 
+	// the matrices the current predictor was trained on; with the sparse
+	// kernel the features are row ids into the training table
+	bool sparse_kernel;
+	CMatrix* training_labels;
+	CMatrix* training_features;
+	SparseSampleTable* training_table;
+
+	// training running in the background, NULL if there is none
+	GPCTrainingJob* training_job;
+	// when the current model was published (or the GPC created)
+	Clock::time_point model_time;
+
 	bool default_optimization_params;
 	unsigned int max_iters;
 	unsigned int kern_iters;
 	unsigned int noise_iters;
 
-	std::vector<Sample>* buffered_samples;
-
-	// hash map from the labels to their number of occurances
-	// it is only used during the initialization phase for choosing
-	// the labels that occur most often
-	std::map<Label,int>* label_counter;
-
-	void get_training_matrices(CMatrix*& training_labels, CMatrix*& training_features);
+	// the samples, seen through the +1/-1 label view of 'positive_label';
+	// only the window starting at 'window_start' is used for the next training
+	SampleBuffer* samples;
+	bool owns_samples;
+	Label positive_label;
+	long window_start;
+	int n_positive;
+	int n_negative;
+
+	// scratch buffers for the prediction, allocated once
+	CMatrix feature_mat;
+	CMatrix prob_mat;
+	CMatrix result_mat;
+	CMatrix batch_prob_mat;
+	CMatrix batch_result_mat;
+	CMatrix query_mat;
+	CMatrix batch_query_mat;
+
+	void init(int n_features, int active_set_size, unsigned int max_iters, unsigned int kern_iters, unsigned int noise_iters,
+			  bool sparse_kernel, int max_batch_size);
+	void get_training_matrices(CMatrix*& training_labels, CMatrix*& training_features, SparseSampleTable*& training_table);
+	void select_batch(std::vector<long>& batch);
+	CKern* new_kernel(const CKern* params_from, const SparseSampleTable* table);
+	void start_training();
+	void publish_trained_model();
+	void delete_model();
 	void choose_labels_from_buffer();
 	bool is_pure();
 };
 
+// write the non-zero entries of a sparse vector into a row of a dense matrix whose row is zero
+void set_dense_row(CMatrix& mat, unsigned int row, const SparseVector& sv);
+// reset the entries written by set_dense_row, so the matrix can be reused without a full clear
+void clear_dense_row(CMatrix& mat, unsigned int row, const SparseVector& sv);
+
 #endif
 
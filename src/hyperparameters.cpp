@@ -17,17 +17,32 @@ Hyperparameters::Hyperparameters(const string& confFile) {
     numRandomTests = configFile.lookup("Tree.numRandomTests");
     numProjectionFeatures = configFile.lookup("Tree.numProjectionFeatures");
     counterThreshold = configFile.lookup("Tree.counterThreshold");
+    leafModel = configFile.lookup("Tree.leafModel");
+    leafLearningRate = configFile.lookup("Tree.leafLearningRate");
+    minLeafModelSamples = configFile.lookup("Tree.minLeafModelSamples");
 
     // Forest
     numTrees = configFile.lookup("Forest.numTrees");
     numEpochs = configFile.lookup("Forest.numEpochs");
     useSoftVoting = configFile.lookup("Forest.useSoftVoting");
+    earlyExit = configFile.lookup("Forest.earlyExit");
+    evalOrder = configFile.lookup("Forest.evalOrder");
+    earlyExitDelta = configFile.lookup("Forest.earlyExitDelta");
+    numTreeWorkers = configFile.lookup("Forest.numTreeWorkers");
+    treePlacement = configFile.lookup("Forest.treePlacement");
 
 	// GP
 	activeSetSize = configFile.lookup("Gauss.activeSetSize");
 	maxIters = configFile.lookup("Gauss.maxIters");
 	kernIters = configFile.lookup("Gauss.kernIters");
 	noiseIters = configFile.lookup("Gauss.noiseIters");
+	numWorkers = configFile.lookup("Gauss.numWorkers");
+	maxQueueLength = configFile.lookup("Gauss.maxQueueLength");
+	minGPLeafSamples = configFile.lookup("Gauss.minGPLeafSamples");
+	maxGPLeaves = configFile.lookup("Gauss.maxGPLeaves");
+	maxGPMemory = configFile.lookup("Gauss.maxGPMemory");
+	sparseKernel = configFile.lookup("Gauss.sparseKernel");
+	maxBatchSize = configFile.lookup("Gauss.maxBatchSize");
 
     // Data
     trainData = (const char *) configFile.lookup("Data.trainData");
@@ -37,6 +52,8 @@ Hyperparameters::Hyperparameters(const string& confFile) {
 
     numTrain = configFile.lookup("Data.numTrain");
     numTest = configFile.lookup("Data.numTest");
+    chunkSize = configFile.lookup("Data.chunkSize");
+    quantizeBits = configFile.lookup("Data.quantizeBits");
 
     // Output
     verbose = configFile.lookup("Output.verbose");
@@ -15,6 +15,9 @@ class Hyperparameters
     int numProjectionFeatures;
     int counterThreshold;
     int maxDepth;
+    int leafModel;
+    double leafLearningRate;
+    int minLeafModelSamples;
 
     // Online tree
 
@@ -22,12 +25,24 @@ class Hyperparameters
     int numTrees;
     int useSoftVoting;
     int numEpochs;
+    int earlyExit;
+    int evalOrder;
+    double earlyExitDelta;
+    int numTreeWorkers;
+    int treePlacement;
 	
 	// Gaussian Process
 	int activeSetSize;
 	int maxIters;
 	int kernIters;
 	int noiseIters;
+	int numWorkers;
+	int maxQueueLength;
+	int minGPLeafSamples;
+	int maxGPLeaves;
+	int maxGPMemory;
+	int sparseKernel;
+	int maxBatchSize;
 
     // Data
     string trainData;
@@ -37,6 +52,8 @@ class Hyperparameters
 
     int numTrain;
     int numTest;
+    int chunkSize;
+    int quantizeBits;
 
     // Output
     int verbose;
@@ -0,0 +1,232 @@
+#include <cmath>
+
+#include "leafmodel.h"
+#include "utilities.h"
+
+using namespace std;
+
+double FeatureTable::dot(const SparseVector &x) const {
+    double val = 0.0;
+    if (m_isDense) {
+        for (SparseVector::const_iterator itr = x.begin(); itr != x.end(); ++itr) {
+            val += m_dense[itr.index()] * (*itr);
+        }
+        return val;
+    }
+
+    // The features of x are sorted as well, every search starts where the last one ended
+    vector<pair<int, double> >::const_iterator pos = m_sparse.begin();
+    for (SparseVector::const_iterator itr = x.begin(); itr != x.end() && pos != m_sparse.end(); ++itr) {
+        pos = lower_bound(pos, m_sparse.end(), pair<int, double> ((int) itr.index(), -HUGE_VAL));
+        if (pos != m_sparse.end() && pos->first == (int) itr.index()) {
+            val += pos->second * (*itr);
+        }
+    }
+    return val;
+}
+
+void FeatureTable::add(const SparseVector &x, const double &factor) {
+    if (!m_isDense) {
+        int pos = 0;
+        for (SparseVector::const_iterator itr = x.begin(); itr != x.end(); ++itr) {
+            pair<int, double> entry((int) itr.index(), -HUGE_VAL);
+            pos = lower_bound(m_sparse.begin() + pos, m_sparse.end(), entry) - m_sparse.begin();
+            if (pos < (int) m_sparse.size() && m_sparse[pos].first == entry.first) {
+                m_sparse[pos].second += factor * (*itr);
+            } else {
+                entry.second = factor * (*itr);
+                m_sparse.insert(m_sparse.begin() + pos, entry);
+            }
+            pos++;
+        }
+
+        // A pair takes as much memory as two dense entries
+        if (2 * (int) m_sparse.size() <= m_numFeatures) {
+            return;
+        }
+        m_dense.assign(m_numFeatures, 0.0);
+        for (int i = 0; i < (int) m_sparse.size(); i++) {
+            m_dense[m_sparse[i].first] = m_sparse[i].second;
+        }
+        vector<pair<int, double> >().swap(m_sparse);
+        m_isDense = true;
+        return;
+    }
+
+    for (SparseVector::const_iterator itr = x.begin(); itr != x.end(); ++itr) {
+        m_dense[itr.index()] += factor * (*itr);
+    }
+}
+
+LeafModel* LeafModel::create(const Hyperparameters &hp, const int &numClasses, const int &numFeatures) {
+    switch (hp.leafModel) {
+    case LEAF_NAIVE_BAYES:
+        return new NaiveBayesLeaf(numClasses, numFeatures);
+    case LEAF_LOGISTIC:
+        return new LogisticLeaf(numClasses, numFeatures, hp.leafLearningRate);
+    case LEAF_CENTROID:
+        return new CentroidLeaf(numClasses, numFeatures);
+    default:
+        return NULL;
+    }
+}
+
+vector<double>& LeafModel::scratch(const int &numClasses) {
+    static thread_local vector<double> scores;
+    scores.resize(numClasses);
+    return scores;
+}
+
+int LeafModel::addSoftmax(vector<double> &scores, vector<double> &confidence, const double &weight) {
+    int prediction = argmax(scores);
+    if (!weight) {
+        return prediction;
+    }
+
+    double maxScore = scores[prediction], norm = 0.0;
+    for (int i = 0; i < (int) scores.size(); i++) {
+        scores[i] = exp(scores[i] - maxScore);
+        norm += scores[i];
+    }
+    for (int i = 0; i < (int) scores.size(); i++) {
+        confidence[i] += weight * scores[i] / norm;
+    }
+
+    return prediction;
+}
+
+// Naive Bayes
+NaiveBayesLeaf::NaiveBayesLeaf(const int &numClasses, const int &numFeatures) :
+    m_numClasses(&numClasses), m_numFeatures(&numFeatures), m_classCounts(numClasses, 0.0),
+            m_featureTotals(numClasses, 0.0), m_featureSums(numClasses, FeatureTable(numFeatures)) {
+}
+
+void NaiveBayesLeaf::update(Sample &sample) {
+    m_classCounts[sample.y] += sample.w;
+
+    m_featureSums[sample.y].add(sample.x, sample.w);
+    for (SparseVector::const_iterator itr = sample.x.begin(); itr != sample.x.end(); ++itr) {
+        m_featureTotals[sample.y] += sample.w * (*itr);
+    }
+}
+
+int NaiveBayesLeaf::eval(Sample &sample, vector<double> &confidence, const double &weight) {
+    vector<double> &scores = scratch(*m_numClasses);
+
+    // log p(c) + sum_j x_j log theta_cj, with theta_cj = (sum_cj + 1) / (total_c + numFeatures)
+    double length = 0.0;
+    for (SparseVector::const_iterator itr = sample.x.begin(); itr != sample.x.end(); ++itr) {
+        length += *itr;
+    }
+    for (int c = 0; c < *m_numClasses; c++) {
+        const FeatureTable &sums = m_featureSums[c];
+        double score = log(m_classCounts[c] + 1.0) - length * log(m_featureTotals[c] + *m_numFeatures);
+        for (SparseVector::const_iterator itr = sample.x.begin(); itr != sample.x.end(); ++itr) {
+            score += (*itr) * log(sums[itr.index()] + 1.0);
+        }
+        scores[c] = score;
+    }
+
+    return addSoftmax(scores, confidence, weight);
+}
+
+long NaiveBayesLeaf::memoryUsage() const {
+    long numBytes = sizeof(NaiveBayesLeaf) + (long) *m_numClasses * (2 * sizeof(double) + sizeof(FeatureTable));
+    for (int c = 0; c < *m_numClasses; c++) {
+        numBytes += m_featureSums[c].memoryUsage();
+    }
+    return numBytes;
+}
+
+// Logistic regression
+LogisticLeaf::LogisticLeaf(const int &numClasses, const int &numFeatures, const double &learningRate) :
+    m_numClasses(&numClasses), m_learningRate(learningRate), m_bias(numClasses, 0.0),
+            m_weights(numClasses, FeatureTable(numFeatures)) {
+}
+
+void LogisticLeaf::computeScores(Sample &sample, vector<double> &scores) {
+    for (int c = 0; c < *m_numClasses; c++) {
+        scores[c] = m_bias[c] + m_weights[c].dot(sample.x);
+    }
+}
+
+void LogisticLeaf::update(Sample &sample) {
+    vector<double> &scores = scratch(*m_numClasses);
+    computeScores(sample, scores);
+
+    // Softmax probabilities, then one gradient step on the log loss
+    double maxScore = scores[argmax(scores)], norm = 0.0;
+    for (int c = 0; c < *m_numClasses; c++) {
+        scores[c] = exp(scores[c] - maxScore);
+        norm += scores[c];
+    }
+    for (int c = 0; c < *m_numClasses; c++) {
+        double step = m_learningRate * sample.w * (((c == sample.y) ? 1.0 : 0.0) - scores[c] / norm);
+        m_bias[c] += step;
+        m_weights[c].add(sample.x, step);
+    }
+}
+
+int LogisticLeaf::eval(Sample &sample, vector<double> &confidence, const double &weight) {
+    vector<double> &scores = scratch(*m_numClasses);
+    computeScores(sample, scores);
+    return addSoftmax(scores, confidence, weight);
+}
+
+long LogisticLeaf::memoryUsage() const {
+    long numBytes = sizeof(LogisticLeaf) + (long) *m_numClasses * (sizeof(double) + sizeof(FeatureTable));
+    for (int c = 0; c < *m_numClasses; c++) {
+        numBytes += m_weights[c].memoryUsage();
+    }
+    return numBytes;
+}
+
+// Nearest centroid
+CentroidLeaf::CentroidLeaf(const int &numClasses, const int &numFeatures) :
+    m_numClasses(&numClasses), m_classCounts(numClasses, 0.0), m_sumNorms(numClasses, 0.0),
+            m_sums(numClasses, FeatureTable(numFeatures)) {
+}
+
+void CentroidLeaf::update(Sample &sample) {
+    // |s + w x|^2 = |s|^2 + 2 w s'x + w^2 |x|^2
+    double dot = m_sums[sample.y].dot(sample.x), norm = 0.0;
+    for (SparseVector::const_iterator itr = sample.x.begin(); itr != sample.x.end(); ++itr) {
+        norm += (*itr) * (*itr);
+    }
+    m_sums[sample.y].add(sample.x, sample.w);
+
+    m_sumNorms[sample.y] += 2.0 * sample.w * dot + sample.w * sample.w * norm;
+    m_classCounts[sample.y] += sample.w;
+}
+
+int CentroidLeaf::eval(Sample &sample, vector<double> &confidence, const double &weight) {
+    vector<double> &scores = scratch(*m_numClasses);
+
+    // Negative squared distance to the class mean m = s / n, without the constant |x|^2:
+    // 2 x'm - |m|^2. Classes without samples are never chosen.
+    for (int c = 0; c < *m_numClasses; c++) {
+        if (!m_classCounts[c]) {
+            scores[c] = -1e100;
+            continue;
+        }
+
+        double dot = m_sums[c].dot(sample.x);
+        scores[c] = 2.0 * dot / m_classCounts[c] - m_sumNorms[c] / (m_classCounts[c] * m_classCounts[c]);
+    }
+
+    int prediction = argmax(scores);
+    if (weight) {
+        // The nearest centroid takes the whole vote
+        confidence[prediction] += weight;
+    }
+
+    return prediction;
+}
+
+long CentroidLeaf::memoryUsage() const {
+    long numBytes = sizeof(CentroidLeaf) + (long) *m_numClasses * (2 * sizeof(double) + sizeof(FeatureTable));
+    for (int c = 0; c < *m_numClasses; c++) {
+        numBytes += m_sums[c].memoryUsage();
+    }
+    return numBytes;
+}
@@ -0,0 +1,132 @@
+#ifndef LEAFMODEL_H_
+#define LEAFMODEL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "data.h"
+#include "hyperparameters.h"
+
+using namespace std;
+
+typedef enum {
+    LEAF_MAJORITY, LEAF_NAIVE_BAYES, LEAF_LOGISTIC, LEAF_CENTROID
+} LEAF_MODEL_TYPE;
+
+//! Values of one class per feature, zero for the features that were never added to. Only
+//! those features are stored, as a sorted list of (feature, value) pairs, until the list
+//! would take more memory than a dense vector and is switched to one. Leaves of data sets
+//! with many features thus only pay for the features their samples actually have.
+class FeatureTable {
+public:
+    explicit FeatureTable(const int &numFeatures) :
+        m_numFeatures(numFeatures), m_isDense(false) {
+    }
+
+    double operator[](const int &feature) const {
+        if (m_isDense) {
+            return m_dense[feature];
+        }
+        vector<pair<int, double> >::const_iterator itr = lower_bound(m_sparse.begin(), m_sparse.end(),
+                                                                     pair<int, double> (feature, -HUGE_VAL));
+        return (itr != m_sparse.end() && itr->first == feature) ? itr->second : 0.0;
+    }
+
+    //! Sum of the values at the non-zero features of x, weighted by them
+    double dot(const SparseVector &x) const;
+
+    //! Adds factor times x
+    void add(const SparseVector &x, const double &factor);
+
+    long memoryUsage() const {
+        return m_dense.capacity() * sizeof(double) + m_sparse.capacity() * sizeof(pair<int, double> );
+    }
+
+private:
+    int m_numFeatures;
+    bool m_isDense;
+    vector<double> m_dense;
+    vector<pair<int, double> > m_sparse;
+};
+
+//! A cheap classifier refining the prediction of a max depth leaf. Update and eval cost
+//! O(nnz * numClasses) lookups for a sample with nnz non-zero features, the per class
+//! feature tables only grow with the features seen by the leaf.
+class LeafModel {
+public:
+    virtual ~LeafModel() {
+    }
+
+    virtual void update(Sample &sample) = 0;
+
+    //! Adds weight times the class distribution of the sample to confidence and returns the
+    //! prediction. A zero weight only returns the prediction.
+    virtual int eval(Sample &sample, vector<double> &confidence, const double &weight) = 0;
+
+    virtual long memoryUsage() const = 0;
+
+    //! Creates the model selected by hp.leafModel, or NULL for majority voting
+    static LeafModel* create(const Hyperparameters &hp, const int &numClasses, const int &numFeatures);
+
+protected:
+    //! Turns the class scores in scores into probabilities and adds them to confidence
+    static int addSoftmax(vector<double> &scores, vector<double> &confidence, const double &weight);
+
+    //! Per thread scratch buffer for the class scores
+    static vector<double>& scratch(const int &numClasses);
+};
+
+//! Multinomial naive Bayes with Laplace smoothing, for non-negative (count or binary) features
+class NaiveBayesLeaf: public LeafModel {
+public:
+    NaiveBayesLeaf(const int &numClasses, const int &numFeatures);
+
+    virtual void update(Sample &sample);
+    virtual int eval(Sample &sample, vector<double> &confidence, const double &weight);
+    virtual long memoryUsage() const;
+
+private:
+    const int *m_numClasses;
+    const int *m_numFeatures;
+    vector<double> m_classCounts;
+    vector<double> m_featureTotals;
+    vector<FeatureTable> m_featureSums;
+};
+
+//! Multinomial logistic regression trained with plain stochastic gradient descent
+class LogisticLeaf: public LeafModel {
+public:
+    LogisticLeaf(const int &numClasses, const int &numFeatures, const double &learningRate);
+
+    virtual void update(Sample &sample);
+    virtual int eval(Sample &sample, vector<double> &confidence, const double &weight);
+    virtual long memoryUsage() const;
+
+private:
+    const int *m_numClasses;
+    double m_learningRate;
+    vector<double> m_bias;
+    vector<FeatureTable> m_weights;
+
+    void computeScores(Sample &sample, vector<double> &scores);
+};
+
+//! Nearest class mean, with squared distances from the cached norms of the class sums
+class CentroidLeaf: public LeafModel {
+public:
+    CentroidLeaf(const int &numClasses, const int &numFeatures);
+
+    virtual void update(Sample &sample);
+    virtual int eval(Sample &sample, vector<double> &confidence, const double &weight);
+    virtual long memoryUsage() const;
+
+private:
+    const int *m_numClasses;
+    vector<double> m_classCounts;
+    vector<double> m_sumNorms;
+    vector<FeatureTable> m_sums;
+};
+
+#endif /* LEAFMODEL_H_ */
@@ -1,51 +1,65 @@
+#include <algorithm>
+
 #include "mgpc.h"
 
 MGPC::MGPC(const Hyperparameters &hp, const int &numClasses, const int &numFeatures, const Label &label, int active_set_size):
-	m_numClasses(&numClasses) {
+	m_numClasses(&numClasses), m_hp(&hp), feature_mat(1, numFeatures) {
 	this->label = label;
 	this->m_label = label;
 
 	cout << "--- Online Gaussian Process Initialization --- Label: " << m_label << " --- " << endl;
 	for (Label i = 0; i < *m_numClasses; i++) {
-		GPC *gpc = new GPC(numFeatures, hp.activeSetSize, hp.maxIters, hp.kernIters, hp.noiseIters);
+		GPC *gpc = new GPC(&samples, i, numFeatures, hp.activeSetSize, hp.maxIters, hp.kernIters, hp.noiseIters,
+						   hp.sparseKernel, hp.maxBatchSize);
 		mgpc_map.insert(std::map<Label,GPC*>::value_type(i,gpc));
 	}
 }
 
 MGPC::MGPC(const Hyperparameters &hp, const int &numClasses, const int &numFeatures):
-	m_numClasses(&numClasses), m_hp(&hp) {
+	m_numClasses(&numClasses), m_hp(&hp), feature_mat(1, numFeatures) {
 	this->m_label = 0;
 	for (Label i = 0; i < *m_numClasses; i++) {
-		GPC *gpc = new GPC(numFeatures, hp.activeSetSize, hp.maxIters, hp.kernIters, hp.noiseIters);
+		GPC *gpc = new GPC(&samples, i, numFeatures, hp.activeSetSize, hp.maxIters, hp.kernIters, hp.noiseIters,
+						   hp.sparseKernel, hp.maxBatchSize);
 		mgpc_map.insert(std::map<Label,GPC*>::value_type(i,gpc));
 	}
 }
 
+MGPC::~MGPC() {
+	for (std::map<Label,GPC*>::iterator it = mgpc_map.begin(); it != mgpc_map.end(); it++) {
+		delete it->second;
+	}
+}
+
 void MGPC::update(Sample &s) {
+	// store the sample once, each GPC sees it through its own one-vs-rest label view
+	samples.push_back(s);
+
+	long window_start = samples.end_index();
 	for (Label i = 0; i < *m_numClasses; i++) {
-		Sample sample;
-		sample.x = s.x;
-		
-		if(s.y == i)
-			sample.y = 1;
-		else
-			sample.y = -1;
-	
-		sample.w = 1.0;
-
-		mgpc_map[i]->update(sample);
+		mgpc_map[i]->update_from_buffer();
+		window_start = std::min(window_start, mgpc_map[i]->get_window_start());
 	}
+
+	samples.discard_before(window_start);
 }
 
 Label MGPC::predict(const SparseVector& features) {
 	int argmax = m_label;
 	double max = 0;
+
+	// densify once for all one-vs-rest classifiers, the sparse kernel works on the sample itself
+	if (!m_hp->sparseKernel)
+		set_dense_row(feature_mat, 0, features);
 	for (int i = 0; i < *m_numClasses; i++) {
-		if(max < mgpc_map[i]->likelihood(features)) {
-			max = mgpc_map[i]->likelihood(features);
+		double likelihood = (m_hp->sparseKernel) ? mgpc_map[i]->likelihood(features) : mgpc_map[i]->likelihood(feature_mat);
+		if(max < likelihood) {
+			max = likelihood;
 			argmax = i;
 		}
 	}
+	if (!m_hp->sparseKernel)
+		clear_dense_row(feature_mat, 0, features);
 
 	if(max < 0.00001) {
 		cout << "--- Online Gaussian prediction error ---" << endl;
@@ -53,6 +67,42 @@ Label MGPC::predict(const SparseVector& features) {
 	return argmax; // if there is no good prediction, it returns the default label
 }
 
+long MGPC::memoryUsage() const {
+	long numBytes = sizeof(MGPC) + samples.memory_usage();
+	for (std::map<Label,GPC*>::const_iterator it = mgpc_map.begin(); it != mgpc_map.end(); it++) {
+		numBytes += it->second->memory_usage();
+	}
+
+	return numBytes;
+}
+
+void MGPC::likelihoods(const CMatrix &features, CMatrix &likelihoods) {
+	if(likelihoods.getRows() != features.getRows() || likelihoods.getCols() != (unsigned int) *m_numClasses) {
+		likelihoods.resize(features.getRows(), *m_numClasses);
+	}
+
+	for (int i = 0; i < *m_numClasses; i++) {
+		mgpc_map[i]->likelihood(features, likelihoods, i);
+	}
+}
+
+void MGPC::predict(const CMatrix &features, vector<Label> &predictions) {
+	likelihoods(features, batch_likelihoods);
+
+	predictions.resize(features.getRows());
+	for (unsigned int n = 0; n < features.getRows(); n++) {
+		int argmax = m_label;
+		double max = 0;
+		for (int i = 0; i < *m_numClasses; i++) {
+			if(max < batch_likelihoods.getVal(n, i)) {
+				max = batch_likelihoods.getVal(n, i);
+				argmax = i;
+			}
+		}
+		predictions[n] = argmax; // if there is no good prediction, it keeps the default label
+	}
+}
+
 void MGPC::train(DataSet &dataset) {
 	vector<int> randIndex;
 	int sampRatio = dataset.m_numSamples / 10;
@@ -85,14 +135,52 @@ Result MGPC::eval(Sample &sample) {
 
 	result.confidence = confidence;
 	result.prediction = argmax;
-	std::cout << "Prediction: " << argmax << ", Label: " << sample.y << ", confidence: " << confidence << ";" << std::endl;
+	if (m_hp->verbose >= 4)
+		std::cout << "Prediction: " << argmax << ", Label: " << sample.y << ", confidence: " << confidence << ";" << std::endl;
 	return result;
 }
 
 vector<Result> MGPC::test(DataSet &dataset) {
 	vector<Result> results;
-	for (int i = 0; i < dataset.m_numSamples; i++) {
-		results.push_back(eval(dataset.m_samples[i]));
+
+	// evaluate the test set in dense batches, so each GPC sees many samples per kernel evaluation;
+	// unused rows of the last batch stay zero and their results are ignored
+	CMatrix features(batch_size, feature_mat.getCols());
+	for (int start = 0; start < dataset.m_numSamples; start += batch_size) {
+		int n_batch = std::min(batch_size, dataset.m_numSamples - start);
+
+		if (m_hp->sparseKernel) {
+			if (batch_likelihoods.getRows() != (unsigned int) n_batch || batch_likelihoods.getCols() != (unsigned int) *m_numClasses)
+				batch_likelihoods.resize(n_batch, *m_numClasses);
+			for (int i = 0; i < *m_numClasses; i++) {
+				mgpc_map[i]->likelihood(dataset.m_samples, start, n_batch, batch_likelihoods, i);
+			}
+		} else {
+			for (int n = 0; n < n_batch; n++) {
+				set_dense_row(features, n, dataset.m_samples[start + n].x);
+			}
+
+			likelihoods(features, batch_likelihoods);
+		}
+
+		for (int n = 0; n < n_batch; n++) {
+			Result result;
+			int argmax = m_label;
+			double max = 0;
+			for (int i = 0; i < *m_numClasses; i++) {
+				double likelihood = batch_likelihoods.getVal(n, i);
+				result.confidence.push_back(likelihood);
+				if(max < likelihood) {
+					max = likelihood;
+					argmax = i;
+				}
+			}
+			result.prediction = argmax;
+			results.push_back(result);
+
+			if (!m_hp->sparseKernel)
+				clear_dense_row(features, n, dataset.m_samples[start + n].x);
+		}
 	}
 
 	double error = compError(results, dataset);
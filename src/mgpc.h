@@ -5,11 +5,21 @@
 //  #define RESTLABEL -1;
 class MGPC: public Classifier {
 public:
-	MGPC(const Hyperparameters &hp, const int &numClasses, const int &numFeatures, const Label &label=0, int active_set_size=20);
+	MGPC(const Hyperparameters &hp, const int &numClasses, const int &numFeatures, const Label &label, int active_set_size=20);
     MGPC(const Hyperparameters &hp, const int &numClasses, const int &numFeatures);
+	~MGPC();
 		
 	virtual void update(Sample &s);
 	Label predict(const SparseVector &features);
+
+	// likelihoods of every class for all rows of a dense n x numFeatures matrix, written to the n x numClasses matrix
+	// (dense kernel only)
+	void likelihoods(const CMatrix &features, CMatrix &likelihoods);
+	// predictions for all rows of a dense n x numFeatures matrix (dense kernel only)
+	void predict(const CMatrix &features, vector<Label> &predictions);
+
+	// approximate memory of all one-vs-rest models and the shared sample buffer
+	long memoryUsage() const;
 	
 	virtual void train(DataSet &dataset);
 	
@@ -23,8 +33,30 @@ private:
 	const Hyperparameters *m_hp;
 
 	std::map<Label, GPC*> mgpc_map;
+
+	// samples shared by all one-vs-rest classifiers
+	SampleBuffer samples;
+
+	// dense scratch sample shared by all one-vs-rest classifiers
+	CMatrix feature_mat;
+	CMatrix batch_likelihoods;
+
+	// number of samples densified at once in test()
+	static const int batch_size = 256;
 	
 	Label m_label;
 	Label label;
 };
 
+//! Deletes an MGPC on a worker of the background pool. The destructor waits for running
+//! training jobs, which must not stall the thread that updates the forest.
+class MGPCReleaseJob: public Job {
+public:
+	explicit MGPCReleaseJob(MGPC *mgpc) : mgpc(mgpc) {}
+
+	virtual void run() {
+		delete mgpc;
+	}
+
+	MGPC* mgpc;
+};
@@ -0,0 +1,298 @@
+#include "modelregistry.h"
+
+using namespace std;
+
+//! A forest with everything it keeps references to
+class ModelRegistry::Model {
+public:
+    Model(const Hyperparameters &hp, const int &numClasses, const int &numFeatures, const vector<double> &minFeatRange,
+          const vector<double> &maxFeatRange, const long &memoryQuota) :
+        m_hp(hp), m_numClasses(numClasses), m_numFeatures(numFeatures), m_minFeatRange(minFeatRange),
+                m_maxFeatRange(maxFeatRange), m_numUncheckedUpdates(0), m_isScheduled(false), m_isOverQuota(false) {
+        // Tree workers of every model would oversubscribe the cores the registry's workers use
+        m_hp.numTreeWorkers = 0;
+        m_forest = new OnlineRF(m_hp, m_numClasses, m_numFeatures, m_minFeatRange, m_maxFeatRange, 0);
+
+        m_stats.numUpdates = 0;
+        m_stats.numRejected = 0;
+        m_stats.numEvals = 0;
+        m_stats.queueLength = 0;
+        m_stats.memoryUsage = m_forest->memoryUsage();
+        m_stats.memoryQuota = memoryQuota;
+    }
+
+    ~Model() {
+        delete m_forest;
+    }
+
+    Hyperparameters m_hp;
+    int m_numClasses;
+    int m_numFeatures;
+    vector<double> m_minFeatRange;
+    vector<double> m_maxFeatRange;
+    OnlineRF *m_forest;
+    // Updates since the last memory check, only touched by the worker running the model
+    long m_numUncheckedUpdates;
+
+    // Guarded by the registry's mutex
+    deque<Request*> m_queue;
+    bool m_isScheduled; // in the ready queue or running
+    bool m_isOverQuota;
+    ModelStats m_stats;
+};
+
+//! Queued work on one model. The requests are jobs, so a caller can wait for them.
+class ModelRegistry::Request: public Job {
+public:
+    Model *model;
+    //! Deleted by the worker once done, otherwise the caller waits for it and deletes it
+    bool isOwnedByRegistry;
+};
+
+class ModelRegistry::UpdateRequest: public Request {
+public:
+    Sample sample;
+    bool isApplied;
+
+    virtual void run() {
+        isApplied = !model->m_isOverQuota;
+        if (isApplied) {
+            model->m_forest->update(sample);
+        }
+    }
+};
+
+class ModelRegistry::EvalRequest: public Request {
+public:
+    Sample *sample;
+    Result result;
+
+    virtual void run() {
+        result = model->m_forest->eval(*sample);
+    }
+};
+
+ModelRegistry::ModelRegistry(const int &numWorkers, const int &quantum, const int &memoryCheckInterval) :
+    m_quantum(quantum), m_memoryCheckInterval(memoryCheckInterval), m_stopping(false) {
+    // Without workers nothing would ever run the queued requests
+    if (numWorkers <= 0) {
+        cout << "A model registry needs at least one worker." << endl;
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < numWorkers; i++) {
+        m_workers.push_back(thread(&ModelRegistry::work, this));
+    }
+}
+
+ModelRegistry::~ModelRegistry() {
+    vector<string> modelNames = names();
+    for (int i = 0; i < (int) modelNames.size(); i++) {
+        remove(modelNames[i]);
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_readyCond.notify_all();
+    for (int i = 0; i < (int) m_workers.size(); i++) {
+        m_workers[i].join();
+    }
+}
+
+bool ModelRegistry::add(const string &name, const Hyperparameters &hp, const int &numClasses, const int &numFeatures,
+                        const vector<double> &minFeatRange, const vector<double> &maxFeatRange, const long &memoryQuota) {
+    if (contains(name)) {
+        return false;
+    }
+    // Built outside of the lock, growing the trees of a large forest takes a while
+    Model *model = new Model(hp, numClasses, numFeatures, minFeatRange, maxFeatRange, memoryQuota);
+
+    lock_guard<mutex> lock(m_mutex);
+    if (m_models.count(name)) {
+        delete model;
+        return false;
+    }
+    m_models[name] = model;
+    return true;
+}
+
+bool ModelRegistry::remove(const string &name) {
+    Model *model;
+    {
+        unique_lock<mutex> lock(m_mutex);
+        map<string, Model*>::iterator itr = m_models.find(name);
+        if (itr == m_models.end()) {
+            return false;
+        }
+        model = itr->second;
+        m_models.erase(itr);
+
+        while (model->m_isScheduled) {
+            m_idleCond.wait(lock);
+        }
+    }
+
+    delete model;
+    return true;
+}
+
+bool ModelRegistry::contains(const string &name) {
+    lock_guard<mutex> lock(m_mutex);
+    return m_models.count(name) > 0;
+}
+
+vector<string> ModelRegistry::names() {
+    lock_guard<mutex> lock(m_mutex);
+    vector<string> modelNames;
+    for (map<string, Model*>::iterator itr = m_models.begin(); itr != m_models.end(); ++itr) {
+        modelNames.push_back(itr->first);
+    }
+    return modelNames;
+}
+
+bool ModelRegistry::update(const string &name, const Sample &sample) {
+    lock_guard<mutex> lock(m_mutex);
+    Model *model = find(name);
+    if (model == NULL) {
+        return false;
+    }
+    if (model->m_isOverQuota) {
+        model->m_stats.numRejected++;
+        return false;
+    }
+
+    UpdateRequest *request = new UpdateRequest();
+    request->sample = sample;
+    request->isOwnedByRegistry = true;
+    push(model, request);
+    return true;
+}
+
+bool ModelRegistry::eval(const string &name, Sample &sample, Result &result) {
+    EvalRequest request;
+    request.sample = &sample;
+    request.isOwnedByRegistry = false;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        Model *model = find(name);
+        if (model == NULL) {
+            return false;
+        }
+        push(model, &request);
+    }
+
+    request.wait();
+    result = request.result;
+    return true;
+}
+
+void ModelRegistry::wait(const string &name) {
+    unique_lock<mutex> lock(m_mutex);
+    Model *model = find(name);
+    while (model != NULL && model->m_isScheduled) {
+        m_idleCond.wait(lock);
+        model = find(name);
+    }
+}
+
+bool ModelRegistry::getStats(const string &name, ModelStats &stats) {
+    lock_guard<mutex> lock(m_mutex);
+    Model *model = find(name);
+    if (model == NULL) {
+        return false;
+    }
+    stats = model->m_stats;
+    stats.queueLength = (int) model->m_queue.size();
+    return true;
+}
+
+ModelRegistry::Model* ModelRegistry::find(const string &name) {
+    map<string, Model*>::iterator itr = m_models.find(name);
+    return (itr == m_models.end()) ? NULL : itr->second;
+}
+
+void ModelRegistry::push(Model *model, Request *request) {
+    request->model = model;
+    model->m_queue.push_back(request);
+    if (!model->m_isScheduled) {
+        model->m_isScheduled = true;
+        m_ready.push_back(model);
+        m_readyCond.notify_one();
+    }
+}
+
+void ModelRegistry::work() {
+    vector<Request*> turn;
+    while (true) {
+        Model *model;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            while (!m_stopping && m_ready.empty()) {
+                m_readyCond.wait(lock);
+            }
+            if (m_stopping) {
+                return;
+            }
+
+            model = m_ready.front();
+            m_ready.pop_front();
+            turn.clear();
+            while (!model->m_queue.empty() && (int) turn.size() < m_quantum) {
+                turn.push_back(model->m_queue.front());
+                model->m_queue.pop_front();
+            }
+        }
+
+        // Only this worker touches the forest until the model is scheduled again
+        long numUpdates = 0, numRejected = 0, numEvals = 0;
+        for (int i = 0; i < (int) turn.size(); i++) {
+            turn[i]->run();
+            UpdateRequest *update = dynamic_cast<UpdateRequest*> (turn[i]);
+            if (update != NULL && update->isApplied) {
+                numUpdates++;
+            } else if (update != NULL) {
+                numRejected++;
+            } else {
+                numEvals++;
+            }
+
+            // A waiting caller gets its result right away, not after the rest of the turn. It
+            // owns the request, which is gone once it has been woken up.
+            if (!turn[i]->isOwnedByRegistry) {
+                turn[i]->finish();
+                turn[i] = NULL;
+            }
+        }
+        long memoryUsage = -1;
+        model->m_numUncheckedUpdates += numUpdates;
+        if (model->m_numUncheckedUpdates >= m_memoryCheckInterval) {
+            memoryUsage = model->m_forest->memoryUsage();
+            model->m_numUncheckedUpdates = 0;
+        }
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            model->m_stats.numUpdates += numUpdates;
+            model->m_stats.numRejected += numRejected;
+            model->m_stats.numEvals += numEvals;
+            if (memoryUsage >= 0) {
+                model->m_stats.memoryUsage = memoryUsage;
+                model->m_isOverQuota = model->m_stats.memoryQuota && memoryUsage > model->m_stats.memoryQuota;
+            }
+
+            if (model->m_queue.empty()) {
+                model->m_isScheduled = false;
+                m_idleCond.notify_all();
+            } else {
+                // Back of the line, behind the other models that are waiting
+                m_ready.push_back(model);
+                m_readyCond.notify_one();
+            }
+        }
+
+        for (int i = 0; i < (int) turn.size(); i++) {
+            delete turn[i];
+        }
+    }
+}
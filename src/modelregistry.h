@@ -0,0 +1,96 @@
+#ifndef MODELREGISTRY_H_
+#define MODELREGISTRY_H_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "data.h"
+#include "hyperparameters.h"
+#include "onlinerf.h"
+#include "workerpool.h"
+
+using namespace std;
+
+//! Counters of a model hosted by a ModelRegistry
+class ModelStats {
+public:
+    long numUpdates;
+    long numRejected; // updates dropped because the model was over its memory quota
+    long numEvals;
+    int queueLength;
+    long memoryUsage; // bytes, as of the last memory check
+    long memoryQuota;
+};
+
+//! Hosts many forests in one process, keyed by name. All models share the registry's worker
+//! threads and the process heap, so a model without traffic costs only its memory.
+//!
+//! Updates and evals of a model are queued and run in order, by one worker at a time, so the
+//! forests need no locking. Models with queued work take turns in round robin, each turn runs
+//! at most quantum requests, so a busy model can not starve the others. Measuring the memory
+//! of a forest walks all of its trees, so it is only done after a turn once the model has
+//! applied memoryCheckInterval updates since the last check. A model over its quota rejects
+//! further updates but keeps serving evals; it can overshoot the quota by what the updates
+//! between two checks allocate.
+class ModelRegistry {
+public:
+    //! Exits if numWorkers is not positive
+    ModelRegistry(const int &numWorkers, const int &quantum = 64, const int &memoryCheckInterval = 1024);
+    ~ModelRegistry();
+
+    //! Creates a forest without GP leaves and without tree workers, the registry's workers
+    //! already run the models in parallel. The registry keeps its own copies of the arguments.
+    //! A memoryQuota of 0 does not limit the model. Returns false if the name is taken.
+    bool add(const string &name, const Hyperparameters &hp, const int &numClasses, const int &numFeatures,
+             const vector<double> &minFeatRange, const vector<double> &maxFeatRange, const long &memoryQuota = 0);
+
+    //! Waits for the queued work of the model and deletes it
+    bool remove(const string &name);
+
+    bool contains(const string &name);
+    vector<string> names();
+
+    //! Queues a copy of the sample for training. Pointers to dense or quantized rows are
+    //! copied as they are and must stay valid until the update has run. Returns false if the
+    //! model does not exist or is over its quota.
+    bool update(const string &name, const Sample &sample);
+
+    //! Evaluates the sample after the updates queued before it, blocks until it is done but
+    //! not for the rest of the worker's turn. Returns false if the model does not exist.
+    bool eval(const string &name, Sample &sample, Result &result);
+
+    //! Blocks until all queued work of the model is done
+    void wait(const string &name);
+
+    bool getStats(const string &name, ModelStats &stats);
+
+private:
+    class Model;
+    class Request;
+    class UpdateRequest;
+    class EvalRequest;
+
+    map<string, Model*> m_models;
+    // Models with queued work that no worker is running, in the order they get their turns
+    deque<Model*> m_ready;
+    vector<thread> m_workers;
+    int m_quantum;
+    int m_memoryCheckInterval;
+    bool m_stopping;
+
+    mutex m_mutex;
+    condition_variable m_readyCond;
+    condition_variable m_idleCond;
+
+    void work();
+    //! Queues a request and schedules the model if needed, needs m_mutex
+    void push(Model *model, Request *request);
+    Model* find(const string &name);
+};
+
+#endif /* MODELREGISTRY_H_ */
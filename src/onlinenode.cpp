@@ -1,21 +1,36 @@
+#include <algorithm>
 #include <iostream>
 
 #include "onlinenode.h"
 
 using namespace std;
 
-void OnlineNode::update(Sample &sample) {
-    m_counter += sample.w;
-    m_labelStats[sample.y] += sample.w;
+void OnlineNode::update(Sample &sample, const int &numCopies) {
+    // The copies this node takes before it splits, the rest go down to a child afterwards.
+    // The split can only happen once the counter reaches the threshold, as long as the node
+    // is not at max depth and does not stay pure.
+    int numUpdates = numCopies;
+    if (m_isLeaf && m_depth < m_hp->maxDepth && m_labelStats[sample.y] != m_counter + m_parentCounter) {
+        double counter = m_counter + sample.w;
+        numUpdates = 1;
+        while (numUpdates < numCopies && counter < m_hp->counterThreshold) {
+            counter += sample.w;
+            numUpdates++;
+        }
+    }
+    double weight = numUpdates * sample.w;
+
+    m_counter += weight;
+    m_labelStats.add(sample.y, weight);
 
     if (m_isLeaf) {
         // Update online tests
         for (int i = 0; i < m_hp->numRandomTests; i++) {
-            m_onlineTests[i].update(sample);
+            m_onlineTests[i].update(sample, weight);
         }
 
         // Update the label
-        m_label = argmax(m_labelStats);
+        m_label = m_labelStats.argmax();
 
         // Decide for split
         if (shouldISplit()) {
@@ -40,22 +55,137 @@ void OnlineNode::update(Sample &sample) {
             }
 			
             // Split
-            pair<vector<double> , vector<double> > parentStats = m_bestTest.getStats();
+            pair<ClassHistogram, ClassHistogram> parentStats = m_bestTest.getStats();
             m_rightChildNode = new OnlineNode(*m_hp, *m_numClasses, *m_numFeatures, *m_minFeatRange, *m_maxFeatRange, m_depth + 1,
-											  parentStats.first, enableGP);
+											  parentStats.first, enableGP, m_gpBudget);
             m_leftChildNode = new OnlineNode(*m_hp, *m_numClasses, *m_numFeatures, *m_minFeatRange, *m_maxFeatRange, m_depth + 1,
-											 parentStats.second, enableGP);
-        } else if(shouldITrainGP() && enableGP) {
-			if(mgpc == NULL) {
-				mgpc = new MGPC(*m_hp, *m_numClasses, *m_numFeatures, m_label);
-			}
-			mgpc->update(sample);
+											 parentStats.second, enableGP, m_gpBudget);
+
+            // The copies left after the split go through the new internal node
+            if (numUpdates < numCopies) {
+                update(sample, numCopies - numUpdates);
+            }
+        } else if(shouldITrainGP()) {
+            // The leaf and GP models learn from each copy, they are not linear in the weight
+            for (int n = 0; n < numUpdates; n++) {
+                if (m_hp->leafModel != LEAF_MAJORITY) {
+                    if (m_leafModel == NULL) {
+                        m_leafModel = LeafModel::create(*m_hp, *m_numClasses, *m_numFeatures);
+                    }
+                    m_leafModel->update(sample);
+                    m_leafModelCounter += sample.w;
+                }
+
+                if(enableGP) {
+                    // GPs are only created for leaves with enough traffic
+                    m_gpCounter += sample.w;
+                    if(mgpc == NULL && m_gpCounter >= m_hp->minGPLeafSamples) {
+                        mgpc = new MGPC(*m_hp, *m_numClasses, *m_numFeatures, m_label);
+                    }
+                    if(mgpc != NULL) {
+                        mgpc->update(sample);
+                        m_gpBudget->touch(this, mgpc->memoryUsage());
+                    }
+                }
+            }
 		}
     } else {
         if (m_bestTest.eval(sample)) {
-            m_rightChildNode->update(sample);
+            m_rightChildNode->update(sample, numCopies);
         } else {
-            m_leftChildNode->update(sample);
+            m_leftChildNode->update(sample, numCopies);
+        }
+    }
+}
+
+void OnlineNode::freeze() {
+    vector<HyperplaneFeature>().swap(m_onlineTests);
+
+    if (m_isLeaf) {
+        // Scaled exactly as eval does, with a total count of 1 eval gives the same values
+        if (m_counter + m_parentCounter) {
+            m_labelStats.scale(1.0 / (m_counter + m_parentCounter));
+            m_counter = 1.0;
+            m_parentCounter = 0.0;
+        }
+    } else {
+        m_labelStats.clear();
+        m_bestTest.freeze();
+        m_leftChildNode->freeze();
+        m_rightChildNode->freeze();
+    }
+}
+
+long OnlineNode::memoryUsage() const {
+    long numBytes = sizeof(OnlineNode) + m_labelStats.memoryUsage() + m_onlineTests.capacity() * sizeof(HyperplaneFeature);
+    for (int i = 0; i < (int) m_onlineTests.size(); i++) {
+        numBytes += m_onlineTests[i].memoryUsage() - sizeof(HyperplaneFeature);
+    }
+
+    if (m_leafModel != NULL) {
+        numBytes += m_leafModel->memoryUsage();
+    }
+    if (!m_isLeaf) {
+        numBytes += m_bestTest.memoryUsage() - sizeof(HyperplaneFeature);
+        numBytes += m_leftChildNode->memoryUsage() + m_rightChildNode->memoryUsage();
+    }
+
+    return numBytes;
+}
+
+// Samples that walk down a tree together in evalBatch(). Enough to keep many cache misses in
+// flight, few enough for their state to stay in L1.
+static const int BATCH_GROUP_SIZE = 16;
+
+void OnlineNode::evalBatch(const vector<Sample*> &samples, vector<vector<double> > &confidences, const double &weight,
+                           vector<int> &predictions) {
+    predictions.resize(samples.size());
+
+    // Each sample of a group is a small state machine. On arriving at a node it prefetches
+    // the node's test, and on its next turn it evaluates the test and prefetches the child.
+    // In between, the other samples of the group take their turns.
+    OnlineNode *nodes[BATCH_GROUP_SIZE];
+    int indices[BATCH_GROUP_SIZE];
+    bool isTestFetched[BATCH_GROUP_SIZE];
+
+    for (int start = 0; start < (int) samples.size(); start += BATCH_GROUP_SIZE) {
+        int numActive = min(BATCH_GROUP_SIZE, (int) samples.size() - start);
+        for (int i = 0; i < numActive; i++) {
+            nodes[i] = this;
+            indices[i] = start + i;
+            isTestFetched[i] = false;
+        }
+
+        while (numActive) {
+            int i = 0;
+            while (i < numActive) {
+                OnlineNode *node = nodes[i];
+                if (node->m_isLeaf) {
+                    int n = indices[i];
+                    predictions[n] = node->eval(*samples[n], confidences[n], weight);
+
+                    // The last active sample takes over the slot
+                    numActive--;
+                    nodes[i] = nodes[numActive];
+                    indices[i] = indices[numActive];
+                    isTestFetched[i] = isTestFetched[numActive];
+                    continue;
+                }
+
+                if (!isTestFetched[i]) {
+                    node->m_bestTest.prefetch();
+                    isTestFetched[i] = true;
+                } else {
+                    OnlineNode *child = (node->m_bestTest.eval(*samples[indices[i]])) ? node->m_rightChildNode
+                                                                                     : node->m_leftChildNode;
+                    prefetchRead(child);
+                    prefetchRead(&child->m_leftChildNode);
+                    prefetchRead(&child->m_bestTest);
+                    nodes[i] = child;
+                    isTestFetched[i] = false;
+                }
+                i++;
+            }
         }
     }
 }
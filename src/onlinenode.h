@@ -8,6 +8,8 @@
 #include "randomtest.h"
 #include "utilities.h"
 #include "mgpc.h"
+#include "gpbudget.h"
+#include "leafmodel.h"
 
 using namespace std;
 
@@ -15,44 +17,50 @@ class OnlineNode {
 public:
     OnlineNode() {
         m_isLeaf = true;
+        mgpc = NULL;
+        m_leafModel = NULL;
     }
 
     OnlineNode(const Hyperparameters &hp, const int &numClasses, const int &numFeatures, const vector<double> &minFeatRange,
-			   const vector<double> &maxFeatRange, const int &depth, int enableGP) :
+			   const vector<double> &maxFeatRange, const int &depth, int enableGP, GPLeafBudget *gpBudget) :
         m_numClasses(&numClasses), m_numFeatures(&numFeatures), m_depth(depth), m_isLeaf(true), m_counter(0.0), m_label(-1),
-			m_parentCounter(0.0), m_hp(&hp), m_minFeatRange(&minFeatRange), m_maxFeatRange(&maxFeatRange) {
+			m_parentCounter(0.0), m_hp(&hp), m_minFeatRange(&minFeatRange), m_maxFeatRange(&maxFeatRange),
+			m_labelStats(numClasses), m_gpBudget(gpBudget), m_gpCounter(0.0), m_leafModelCounter(0.0) {
 		
 		this->enableGP = enableGP;
-        for (int i = 0; i < numClasses; i++) {
-            m_labelStats.push_back(0.0);
-        }
 
         // Creating random tests
         for (int i = 0; i < hp.numRandomTests; i++) {
-            HyperplaneFeature test(numClasses, numFeatures, hp.numProjectionFeatures, minFeatRange, maxFeatRange);
+            HyperplaneFeature test(numClasses, numFeatures, hp.numProjectionFeatures, minFeatRange, maxFeatRange,
+                                   hp.quantizeBits);
             m_onlineTests.push_back(test);
         }
 
 		mgpc = NULL;
+        m_leafModel = NULL;
     }
 
     OnlineNode(const Hyperparameters &hp, const int &numClasses, const int &numFeatures, const vector<double> &minFeatRange,
-			   const vector<double> &maxFeatRange, const int &depth, const vector<double> &parentStats, int enableGP) :
+			   const vector<double> &maxFeatRange, const int &depth, const ClassHistogram &parentStats, int enableGP,
+			   GPLeafBudget *gpBudget) :
         m_numClasses(&numClasses), m_numFeatures(&numFeatures), m_depth(depth), m_isLeaf(true), m_counter(0.0), m_label(-1),
-                m_parentCounter(0.0), m_hp(&hp), m_minFeatRange(&minFeatRange), m_maxFeatRange(&maxFeatRange) {
+                m_parentCounter(0.0), m_hp(&hp), m_minFeatRange(&minFeatRange), m_maxFeatRange(&maxFeatRange),
+                m_gpBudget(gpBudget), m_gpCounter(0.0), m_leafModelCounter(0.0) {
         
 			this->enableGP = enableGP;
 		m_labelStats = parentStats;
-        m_label = argmax(m_labelStats);
-        m_parentCounter = sum(m_labelStats);
+        m_label = m_labelStats.argmax();
+        m_parentCounter = m_labelStats.sum();
 
         // Creating random tests
         for (int i = 0; i < hp.numRandomTests; i++) {
-            HyperplaneFeature test(numClasses, numFeatures, hp.numProjectionFeatures, minFeatRange, maxFeatRange);
+            HyperplaneFeature test(numClasses, numFeatures, hp.numProjectionFeatures, minFeatRange, maxFeatRange,
+                                   hp.quantizeBits);
             m_onlineTests.push_back(test);
         }
 
 		mgpc = NULL;
+        m_leafModel = NULL;
     }
 
      ~OnlineNode() {
@@ -60,40 +68,88 @@ public:
             delete m_leftChildNode;
             delete m_rightChildNode;
         }
+        if (mgpc != NULL) {
+            m_gpBudget->remove(this);
+            delete mgpc;
+        }
+        delete m_leafModel;
     }
 
-    void update(Sample &sample);
+    //! Updates the node as numCopies successive updates with the sample would, including when
+    //! the node splits, but with a single traversal
+    void update(Sample &sample, const int &numCopies = 1);
+
+    //! Drops the candidate tests and the statistics of internal nodes, and turns the leaf
+    //! statistics into normalized distributions. Only eval may be called afterwards.
+    void freeze();
+
+    //! Approximate memory of this node and its subtree, without GP models
+    long memoryUsage() const;
+
+    //! Deletes the GP of this leaf, it falls back to the label statistics until it is recreated.
+    //! The GP is freed in the background, as it may have to wait for its training job.
+    void evictGP() {
+        WorkerPool::instance().submitAndRelease(new MGPCReleaseJob(mgpc));
+        mgpc = NULL;
+        m_gpCounter = 0.0;
+    }
 
     Result eval(Sample &sample) {
+        Result result;
+        result.confidence.assign(*m_numClasses, 0.0);
+        result.prediction = eval(sample, result.confidence, 1.0);
+        return result;
+    }
+
+    //! Adds weight times the leaf distribution of the sample to confidence and returns the
+    //! leaf prediction. A zero weight only returns the prediction. Does not allocate.
+    int eval(Sample &sample, vector<double> &confidence, const double &weight) {
         if (m_isLeaf) {
-            Result result;
-			
-			if (m_counter + m_parentCounter) {
-				result.confidence = m_labelStats;
-				scale(result.confidence, 1.0 / (m_counter + m_parentCounter));
-				result.prediction = m_label;
-			} else {
-				for (int i = 0; i < *m_numClasses; i++) {
-					result.confidence.push_back(1.0 / *m_numClasses);
-				}
-				result.prediction = 0;
-			}
-
-			if (mgpc != NULL) {
-				result.prediction = mgpc->predict(sample.x);
-			}
-
-            return result;
+            int prediction;
+
+            // A young leaf model knows less than the counts the leaf inherited from its parent
+            if (m_leafModel != NULL && m_leafModelCounter >= m_hp->minLeafModelSamples) {
+                prediction = m_leafModel->eval(sample, confidence, weight);
+            } else if (m_counter + m_parentCounter) {
+                if (weight) {
+                    double norm = weight / (m_counter + m_parentCounter);
+                    for (int e = 0; e < m_labelStats.numEntries(); e++) {
+                        confidence[m_labelStats.entryLabel(e)] += norm * m_labelStats.entryCount(e);
+                    }
+                }
+                prediction = m_label;
+            } else {
+                if (weight) {
+                    for (int i = 0; i < *m_numClasses; i++) {
+                        confidence[i] += weight / *m_numClasses;
+                    }
+                }
+                prediction = 0;
+            }
+
+            if (mgpc != NULL) {
+                prediction = mgpc->predict(sample.x);
+            }
+
+            return prediction;
         } else {
             if (m_bestTest.eval(sample)) {
-                return m_rightChildNode->eval(sample);
+                return m_rightChildNode->eval(sample, confidence, weight);
             } else {
-                return m_leftChildNode->eval(sample);
+                return m_leftChildNode->eval(sample, confidence, weight);
             }
         }
     }
 
+    //! eval() of every sample, with the samples walking down the tree in lockstep: while the
+    //! nodes of some samples are fetched from memory, the others are working. For trees larger
+    //! than the cache this hides most of the cache misses of deep traversals.
+    void evalBatch(const vector<Sample*> &samples, vector<vector<double> > &confidences, const double &weight,
+                   vector<int> &predictions);
+
 private:
+    friend class CodeExporter;
+
     const int *m_numClasses;
     const int *m_numFeatures;
     int m_depth;
@@ -105,27 +161,25 @@ private:
     const vector<double> *m_minFeatRange;
     const vector<double> *m_maxFeatRange;
 
-    vector<double> m_labelStats;
+    ClassHistogram m_labelStats;
 
     OnlineNode* m_leftChildNode;
     OnlineNode* m_rightChildNode;
 
 	int enableGP;
 	MGPC* mgpc;
+	GPLeafBudget *m_gpBudget;
+	double m_gpCounter; // samples seen at max depth since the GP was created or evicted
+
+    // Cheap model of a max depth leaf (hp.leafModel), NULL for majority voting
+    LeafModel *m_leafModel;
+    double m_leafModelCounter; // samples seen by the leaf model
 
     vector<HyperplaneFeature> m_onlineTests;
     HyperplaneFeature m_bestTest;
 
     bool shouldISplit() {
-        bool isPure = false;
-        for (int i = 0; i < *m_numClasses; i++) {
-            if (m_labelStats[i] == m_counter + m_parentCounter) {
-                isPure = true;
-                break;
-            }
-        }
-
-        if (isPure) {
+        if (m_labelStats.isPure(m_counter + m_parentCounter)) {
             return false;
         }
 
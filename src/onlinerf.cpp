@@ -1,2 +1,215 @@
 #include "onlinerf.h"
 
+// Samples handed to the tree workers at a time. Each block costs one synchronization of the
+// workers, and the votes are collected per block.
+static const int TREE_WORKER_BLOCK_SIZE = 256;
+
+class OnlineRF::BuildTreesTask: public TreeTask {
+public:
+    OnlineRF *forest;
+    // The nodes keep a pointer to the number of features, it must outlive the task
+    const int *numFeatures;
+    const vector<double> *minFeatRange;
+    const vector<double> *maxFeatRange;
+    int enableGP;
+
+    virtual void run(const int &worker, const int &tree) {
+        forest->m_trees[tree] = new OnlineTree(*forest->m_hp, *forest->m_numClasses, *numFeatures, *minFeatRange,
+                                               *maxFeatRange, enableGP, &forest->m_gpBudget);
+    }
+};
+
+class OnlineRF::UpdateTreeTask: public TreeTask {
+public:
+    OnlineRF *forest;
+    vector<Sample*> block;
+
+    virtual void run(const int &worker, const int &tree) {
+        forest->updateTree(worker, tree, block);
+    }
+};
+
+class OnlineRF::EvalTreeTask: public TreeTask {
+public:
+    OnlineRF *forest;
+    vector<Sample*> block;
+
+    virtual void run(const int &worker, const int &tree) {
+        forest->evalTree(worker, tree, block);
+    }
+};
+
+void OnlineRF::buildTrees(const int &numFeatures, const vector<double> &minFeatRange, const vector<double> &maxFeatRange,
+                          const int &enableGP) {
+    BuildTreesTask task;
+    task.forest = this;
+    task.numFeatures = &numFeatures;
+    task.minFeatRange = &minFeatRange;
+    task.maxFeatRange = &maxFeatRange;
+    task.enableGP = enableGP;
+    // Each tree is built by its owner, on the owner's NUMA node
+    m_workers->run(task, STEAL_NONE);
+}
+
+void OnlineRF::trainEpoch(DataSet &dataset, const int &epoch) {
+    vector<int> randIndex;
+    int sampRatio = dataset.m_numSamples / 10;
+    randPerm(dataset.m_numSamples, randIndex);
+
+    if (!m_workers) {
+        for (int i = 0; i < dataset.m_numSamples; i++) {
+            update(dataset.m_samples[randIndex[i]]);
+            if (m_hp->verbose >= 1 && (i % sampRatio) == 0) {
+                cout << "--- Online Random Forest training --- Epoch: " << epoch + 1 << " --- ";
+                cout << (10 * i) / sampRatio << "%" << endl;
+            }
+        }
+        return;
+    }
+
+    UpdateTreeTask task;
+    task.forest = this;
+    for (int start = 0; start < dataset.m_numSamples; start += TREE_WORKER_BLOCK_SIZE) {
+        int end = min(start + TREE_WORKER_BLOCK_SIZE, dataset.m_numSamples);
+        task.block.clear();
+        for (int i = start; i < end; i++) {
+            task.block.push_back(&dataset.m_samples[randIndex[i]]);
+        }
+        updateOnWorkers(task);
+
+        if (m_hp->verbose >= 1) {
+            for (int i = start; i < end; i++) {
+                if ((i % sampRatio) == 0) {
+                    cout << "--- Online Random Forest training --- Epoch: " << epoch + 1 << " --- ";
+                    cout << (10 * i) / sampRatio << "%" << endl;
+                }
+            }
+        }
+    }
+}
+
+void OnlineRF::updateBlock(const vector<Sample*> &samples) {
+    if (!m_workers) {
+        Classifier::updateBlock(samples);
+        return;
+    }
+
+    UpdateTreeTask task;
+    task.forest = this;
+    for (int start = 0; start < (int) samples.size(); start += TREE_WORKER_BLOCK_SIZE) {
+        int end = min(start + TREE_WORKER_BLOCK_SIZE, (int) samples.size());
+        task.block.assign(samples.begin() + start, samples.begin() + end);
+        updateOnWorkers(task);
+    }
+}
+
+void OnlineRF::updateOnWorkers(UpdateTreeTask &task) {
+    if (m_isFrozen) {
+        cout << "Can not update a frozen Online Random Forest." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // A stolen tree grows on the thief's node, keep it on the node the tree was placed on
+    clearWorkerVotes(task.block.size());
+    m_workers->run(task, STEAL_SAME_NODE);
+
+    // Forest out-of-bag error from the votes of all workers
+    for (int s = 0; s < (int) task.block.size(); s++) {
+        m_oobConfidence.assign(*m_numClasses, 0.0);
+        for (int w = 0; w < m_workers->numWorkers(); w++) {
+            for (int c = 0; c < *m_numClasses; c++) {
+                m_oobConfidence[c] += m_workerVotes[w][s][c];
+            }
+        }
+
+        m_counter += task.block[s]->w;
+        if (argmax(m_oobConfidence) != task.block[s]->y) {
+            m_oobe += task.block[s]->w;
+        }
+    }
+    m_evalOrderDirty = true;
+}
+
+vector<Result> OnlineRF::evalBlocks(DataSet &dataset) {
+    vector<Result> results(dataset.m_numSamples);
+    EvalTreeTask task;
+    task.forest = this;
+    for (int start = 0; start < dataset.m_numSamples; start += TREE_WORKER_BLOCK_SIZE) {
+        int end = min(start + TREE_WORKER_BLOCK_SIZE, dataset.m_numSamples);
+        task.block.clear();
+        for (int i = start; i < end; i++) {
+            task.block.push_back(&dataset.m_samples[i]);
+        }
+        clearWorkerVotes(task.block.size());
+        if (m_workers) {
+            m_workers->run(task);
+        } else {
+            for (int i = 0; i < m_hp->numTrees; i++) {
+                evalTree(0, i, task.block);
+            }
+        }
+
+        for (int s = 0; s < (int) task.block.size(); s++) {
+            vector<double> &confidence = results[start + s].confidence;
+            confidence.assign(*m_numClasses, 0.0);
+            for (int w = 0; w < (int) m_workerVotes.size(); w++) {
+                for (int c = 0; c < *m_numClasses; c++) {
+                    confidence[c] += m_workerVotes[w][s][c];
+                }
+            }
+            scale(confidence, 1.0 / m_hp->numTrees);
+            results[start + s].prediction = argmax(confidence);
+        }
+    }
+
+    m_evalCounter += dataset.m_numSamples;
+    m_evalTreesUsed += (double) dataset.m_numSamples * m_hp->numTrees;
+
+    return results;
+}
+
+void OnlineRF::clearWorkerVotes(const int &blockSize) {
+    for (int w = 0; w < (int) m_workerVotes.size(); w++) {
+        m_workerVotes[w].resize(blockSize);
+        for (int s = 0; s < blockSize; s++) {
+            m_workerVotes[w][s].assign(*m_numClasses, 0.0);
+        }
+    }
+}
+
+void OnlineRF::updateTree(const int &worker, const int &tree, const vector<Sample*> &block) {
+    vector<vector<double> > &votes = m_workerVotes[worker];
+    int numTries, treePrediction;
+    for (int s = 0; s < (int) block.size(); s++) {
+        Sample &sample = *block[s];
+        numTries = poisson(1.0);
+        if (numTries) {
+            m_trees[tree]->update(sample, numTries);
+        } else {
+            if (m_hp->useSoftVoting) {
+                treePrediction = m_trees[tree]->eval(sample, votes[s], 1.0);
+            } else {
+                treePrediction = m_trees[tree]->eval(sample, votes[s], 0.0);
+                votes[s][treePrediction]++;
+            }
+
+            m_treeOOBCounts[tree] += sample.w;
+            if (treePrediction != sample.y) {
+                m_treeOOBErrors[tree] += sample.w;
+            }
+        }
+    }
+}
+
+void OnlineRF::evalTree(const int &worker, const int &tree, const vector<Sample*> &block) {
+    vector<vector<double> > &votes = m_workerVotes[worker];
+    vector<int> &predictions = m_workerPredictions[worker];
+    if (m_hp->useSoftVoting) {
+        m_trees[tree]->evalBatch(block, votes, 1.0, predictions);
+    } else {
+        m_trees[tree]->evalBatch(block, votes, 0.0, predictions);
+        for (int s = 0; s < (int) block.size(); s++) {
+            votes[s][predictions[s]]++;
+        }
+    }
+}
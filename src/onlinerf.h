@@ -1,21 +1,44 @@
 #ifndef ONLINERF_H_
 #define ONLINERF_H_
 
+#include <algorithm>
+
 #include "classifier.h"
 #include "data.h"
 #include "hyperparameters.h"
 #include "onlinetree.h"
+#include "treeworkers.h"
 #include "utilities.h"
 
 class OnlineRF: public Classifier {
 public:
     OnlineRF(const Hyperparameters &hp, const int &numClasses, const int &numFeatures, const vector<double> &minFeatRange,
 			 const vector<double> &maxFeatRange, int enableGP) :
-        m_numClasses(&numClasses), m_counter(0.0), m_oobe(0.0), m_hp(&hp) {
-        OnlineTree *tree;
+        m_numClasses(&numClasses), m_counter(0.0), m_oobe(0.0), m_hp(&hp), m_gpBudget(hp), m_evalOrderDirty(true),
+                m_evalCounter(0.0), m_evalTreesUsed(0.0), m_isFrozen(false), m_workers(NULL) {
         for (int i = 0; i < hp.numTrees; i++) {
-            tree = new OnlineTree(hp, numClasses, numFeatures, minFeatRange, maxFeatRange, enableGP);
-            m_trees.push_back(tree);
+            m_treeOOBErrors.push_back(0.0);
+            m_treeOOBCounts.push_back(0.0);
+            m_evalOrder.push_back(i);
+        }
+        m_evalOrderEngine.seed(randomEngine()());
+
+        // The GP leaves share a budget and background training, they are only updated sequentially
+        if (hp.numTreeWorkers > 1 && enableGP) {
+            cout << "Warning: numTreeWorkers is ignored for forests with GP leaves." << endl;
+        } else if (hp.numTreeWorkers > 1) {
+            m_workers = new TreeWorkers(min(hp.numTreeWorkers, hp.numTrees), hp.numTrees, hp.treePlacement);
+        }
+        m_workerVotes.resize((m_workers) ? m_workers->numWorkers() : 1);
+        m_workerPredictions.resize(m_workerVotes.size());
+
+        m_trees.assign(hp.numTrees, NULL);
+        if (m_workers && hp.treePlacement != PLACEMENT_NONE) {
+            buildTrees(numFeatures, minFeatRange, maxFeatRange, enableGP);
+        } else {
+            for (int i = 0; i < hp.numTrees; i++) {
+                m_trees[i] = new OnlineTree(hp, numClasses, numFeatures, minFeatRange, maxFeatRange, enableGP, &m_gpBudget);
+            }
         }
     }
 
@@ -23,101 +46,169 @@ public:
         for (int i = 0; i < m_hp->numTrees; i++) {
             delete m_trees[i];
         }
+        delete m_workers;
     }
 
     virtual void update(Sample &sample) {
+        if (m_isFrozen) {
+            cout << "Can not update a frozen Online Random Forest." << endl;
+            exit(EXIT_FAILURE);
+        }
         m_counter += sample.w;
 
-        Result result, treeResult;
-        for (int i = 0; i < *m_numClasses; i++) {
-            result.confidence.push_back(0.0);
-        }
+        m_oobConfidence.assign(*m_numClasses, 0.0);
 
-        int numTries;
+        int numTries, treePrediction;
         for (int i = 0; i < m_hp->numTrees; i++) {
             numTries = poisson(1.0);
             if (numTries) {
-                for (int n = 0; n < numTries; n++) {
-                    m_trees[i]->update(sample);
-                }
+                m_trees[i]->update(sample, numTries);
             } else {
-                treeResult = m_trees[i]->eval(sample);
                 if (m_hp->useSoftVoting) {
-                    add(treeResult.confidence, result.confidence);
+                    treePrediction = m_trees[i]->eval(sample, m_oobConfidence, 1.0);
                 } else {
-                    result.confidence[treeResult.prediction]++;
+                    treePrediction = m_trees[i]->eval(sample, m_oobConfidence, 0.0);
+                    m_oobConfidence[treePrediction]++;
                 }
+
+                m_treeOOBCounts[i] += sample.w;
+                if (treePrediction != sample.y) {
+                    m_treeOOBErrors[i] += sample.w;
+                }
+                m_evalOrderDirty = true;
             }
         }
 
-        if (argmax(result.confidence) != sample.y) {
+        if (argmax(m_oobConfidence) != sample.y) {
             m_oobe += sample.w;
         }
     }
 
+    //! Updates with the samples in the given order. With tree workers, they go through the
+    //! trees in blocks on the workers, as in train().
+    virtual void updateBlock(const vector<Sample*> &samples);
+
+    //! Drops everything only needed for training: the candidate tests, the statistics of the
+    //! internal nodes and the raw leaf counts, which become normalized distributions. Eval
+    //! gives the same results afterwards, update is no longer allowed. Returns the number of
+    //! bytes reclaimed.
+    long freeze() {
+        long numBytes = m_oobConfidence.capacity() * sizeof(double);
+        vector<double>().swap(m_oobConfidence);
+        for (int i = 0; i < m_hp->numTrees; i++) {
+            numBytes += m_trees[i]->freeze();
+        }
+        m_isFrozen = true;
+
+        return numBytes;
+    }
+
+    //! Approximate memory of the trees, without GP models
+    long memoryUsage() const {
+        long numBytes = sizeof(OnlineRF);
+        for (int i = 0; i < m_hp->numTrees; i++) {
+            numBytes += m_trees[i]->memoryUsage();
+        }
+        return numBytes;
+    }
+
     virtual void train(DataSet &dataset) {
-        vector<int> randIndex;
-        int sampRatio = dataset.m_numSamples / 10;
         for (int n = 0; n < m_hp->numEpochs; n++) {
-            randPerm(dataset.m_numSamples, randIndex);
-            for (int i = 0; i < dataset.m_numSamples; i++) {
-                update(dataset.m_samples[randIndex[i]]);
-                if (m_hp->verbose >= 1 && (i % sampRatio) == 0) {
-                    cout << "--- Online Random Forest training --- Epoch: " << n + 1 << " --- ";
-                    cout << (10 * i) / sampRatio << "%" << endl;
-                }
-            }
+            trainEpoch(dataset, n);
         }
     }
 
     virtual Result eval(Sample &sample) {
-        Result result, treeResult;
-        for (int i = 0; i < *m_numClasses; i++) {
-            result.confidence.push_back(0.0);
+        int numTreesUsed;
+        return eval(sample, numTreesUsed);
+    }
+
+    //! Evaluates the forest, with earlyExit it stops as soon as the vote is decided
+    Result eval(Sample &sample, int &numTreesUsed) {
+        Result result;
+        result.prediction = eval(sample, result.confidence, numTreesUsed);
+        return result;
+    }
+
+    //! Evaluates every tree, in index order and without early exit, as an exported scorer does
+    Result evalAllTrees(Sample &sample) {
+        Result result;
+        int numTreesUsed;
+        result.prediction = eval(sample, result.confidence, numTreesUsed, false);
+        return result;
+    }
+
+    //! Writes the normalized votes into the caller owned confidence buffer and returns the
+    //! prediction. Once the buffer has grown to numClasses, no allocation takes place.
+    int eval(Sample &sample, vector<double> &confidence, int &numTreesUsed, const bool &allowEarlyExit = true) {
+        confidence.assign(*m_numClasses, 0.0);
+
+        bool earlyExit = m_hp->earlyExit && allowEarlyExit;
+        if (earlyExit) {
+            updateEvalOrder();
         }
 
-        for (int i = 0; i < m_hp->numTrees; i++) {
-            treeResult = m_trees[i]->eval(sample);
+        int tree, treePrediction;
+        numTreesUsed = 0;
+        while (numTreesUsed < m_hp->numTrees) {
+            tree = (earlyExit) ? m_evalOrder[numTreesUsed] : numTreesUsed;
             if (m_hp->useSoftVoting) {
-                add(treeResult.confidence, result.confidence);
+                m_trees[tree]->eval(sample, confidence, 1.0);
             } else {
-                result.confidence[treeResult.prediction]++;
+                treePrediction = m_trees[tree]->eval(sample, confidence, 0.0);
+                confidence[treePrediction]++;
+            }
+            numTreesUsed++;
+
+            if (earlyExit && isVoteDecided(confidence, numTreesUsed)) {
+                break;
             }
         }
 
-        scale(result.confidence, 1.0 / m_hp->numTrees);
-        result.prediction = argmax(result.confidence);
-        return result;
+        m_evalCounter++;
+        m_evalTreesUsed += numTreesUsed;
+
+        scale(confidence, 1.0 / numTreesUsed);
+        return argmax(confidence);
     }
 
     virtual vector<Result> test(DataSet &dataset) {
         vector<Result> results;
-        for (int i = 0; i < dataset.m_numSamples; i++) {
-            results.push_back(eval(dataset.m_samples[i]));
+        if (!m_hp->earlyExit) {
+            results = evalBlocks(dataset);
+        } else {
+            for (int i = 0; i < dataset.m_numSamples; i++) {
+                results.push_back(eval(dataset.m_samples[i]));
+            }
         }
 
         double error = compError(results, dataset);
         if (m_hp->verbose >= 1) {
             cout << "--- Online Random Forest test error: " << error << endl;
+            if (m_workers) {
+                cout << "--- Online Random Forest tree tasks stolen by idle workers: " << m_workers->numStolen();
+                cout << " of " << m_workers->numTasks() << endl;
+            }
+            if (m_hp->earlyExit) {
+                cout << "--- Online Random Forest average number of evaluated trees: ";
+                cout << m_evalTreesUsed / m_evalCounter << " of " << m_hp->numTrees << endl;
+            }
+            if (m_gpBudget.numLeaves() || m_gpBudget.numEvictions()) {
+                cout << "--- Online Random Forest GP leaves: " << m_gpBudget.numLeaves() << " using ";
+                cout << m_gpBudget.numBytes() / 1024 << " KB, evicted: " << m_gpBudget.numEvictions() << endl;
+            }
         }
+        m_evalCounter = 0.0;
+        m_evalTreesUsed = 0.0;
 
         return results;
     }
 
     virtual vector<Result> trainAndTest(DataSet &dataset_tr, DataSet &dataset_ts) {
         vector<Result> results;
-        vector<int> randIndex;
-        int sampRatio = dataset_tr.m_numSamples / 10;
         vector<double> testError;
         for (int n = 0; n < m_hp->numEpochs; n++) {
-            randPerm(dataset_tr.m_numSamples, randIndex);
-            for (int i = 0; i < dataset_tr.m_numSamples; i++) {
-                update(dataset_tr.m_samples[randIndex[i]]);
-                if (m_hp->verbose >= 1 && (i % sampRatio) == 0) {
-                    cout << "--- Online Random Forest training --- Epoch: " << n + 1 << " --- ";
-                    cout << (10 * i) / sampRatio << "%" << endl;
-                }
-            }
+            trainEpoch(dataset_tr, n);
 
             results = test(dataset_ts);
             testError.push_back(compError(results, dataset_ts));
@@ -132,12 +223,131 @@ public:
     }
 
 protected:
+    friend class CodeExporter;
+
     const int *m_numClasses;
     double m_counter;
     double m_oobe;
     const Hyperparameters *m_hp;
 
     vector<OnlineTree*> m_trees;
+
+    // Shared by all trees, limits the GP leaves of the whole forest
+    GPLeafBudget m_gpBudget;
+
+    // Scratch buffer for the out-of-bag votes in update()
+    vector<double> m_oobConfidence;
+
+    // Early exit evaluation
+    vector<double> m_treeOOBErrors;
+    vector<double> m_treeOOBCounts;
+    vector<int> m_evalOrder;
+    bool m_evalOrderDirty;
+    mt19937 m_evalOrderEngine;
+    double m_evalCounter;
+    double m_evalTreesUsed;
+
+    bool m_isFrozen;
+
+    // Threads owning blocks of trees, NULL if the trees are trained sequentially
+    TreeWorkers *m_workers;
+    // Votes of the trees each worker has run, for the samples of a block. Without workers
+    // there is a single buffer.
+    vector<vector<vector<double> > > m_workerVotes;
+    vector<vector<int> > m_workerPredictions;
+
+    class BuildTreesTask;
+    class UpdateTreeTask;
+    class EvalTreeTask;
+
+    //! Creates every tree on the worker that owns it
+    void buildTrees(const int &numFeatures, const vector<double> &minFeatRange, const vector<double> &maxFeatRange,
+                    const int &enableGP);
+
+    //! One pass over the data set in random order, on the tree workers if there are any
+    void trainEpoch(DataSet &dataset, const int &epoch);
+
+    //! Updates the trees with the block of the task on the workers and adds the block to the
+    //! out-of-bag error of the forest
+    void updateOnWorkers(UpdateTreeTask &task);
+
+    //! eval() of all samples, block by block. The trees go through a block with a batch
+    //! traversal, on the workers if there are any. Without workers the votes are summed in
+    //! the tree order of eval(), so the results are identical. With workers each worker sums
+    //! the trees it ran and the sums are added up afterwards, so soft votes can differ from
+    //! eval() in the last bits and an exact tie can go the other way.
+    vector<Result> evalBlocks(DataSet &dataset);
+
+    //! Resets the vote buffers of all workers for a block of samples
+    void clearWorkerVotes(const int &blockSize);
+
+    //! update() of a single tree with a block of samples, the out-of-bag votes go to the
+    //! vote buffer of the worker
+    void updateTree(const int &worker, const int &tree, const vector<Sample*> &block);
+
+    //! Adds the votes of a single tree for a block of samples to the vote buffer of the worker
+    void evalTree(const int &worker, const int &tree, const vector<Sample*> &block);
+
+    //! Sets the order in which the trees are visited during evaluation
+    void updateEvalOrder() {
+        switch (m_hp->evalOrder) {
+        case 1: // random, from the forest's own stream so that testing does not change training
+            shuffle(m_evalOrder.begin(), m_evalOrder.end(), m_evalOrderEngine);
+            break;
+        case 2: // lowest out-of-bag error first
+            if (m_evalOrderDirty) {
+                vector<pair<double, int> > treeErrors;
+                for (int i = 0; i < m_hp->numTrees; i++) {
+                    double error = (m_treeOOBCounts[i]) ? m_treeOOBErrors[i] / m_treeOOBCounts[i] : 1.0;
+                    treeErrors.push_back(pair<double, int> (error, i));
+                }
+                sort(treeErrors.begin(), treeErrors.end());
+                for (int i = 0; i < m_hp->numTrees; i++) {
+                    m_evalOrder[i] = treeErrors[i].second;
+                }
+                m_evalOrderDirty = false;
+            }
+            break;
+        default: // tree index
+            for (int i = 0; i < m_hp->numTrees; i++) {
+                m_evalOrder[i] = i;
+            }
+            break;
+        }
+    }
+
+    //! Returns true if the remaining trees can not change the prediction any more, or if the
+    //! margin between the two leading classes exceeds the Hoeffding bound for earlyExitDelta
+    bool isVoteDecided(const vector<double> &votes, const int &numTreesUsed) {
+        // Each tree adds at most one vote (or one unit of soft confidence) to any class
+        double remaining = m_hp->numTrees - numTreesUsed;
+        if (m_hp->useSoftVoting) {
+            remaining += 1e-9;
+        }
+
+        int leader = argmax(votes);
+        double runnerUp = -1.0;
+        bool isDecided = true;
+        for (int i = 0; i < *m_numClasses; i++) {
+            if (i == leader) {
+                continue;
+            }
+            if (votes[i] > runnerUp) {
+                runnerUp = votes[i];
+            }
+            // argmax breaks ties towards the lower index
+            if ((i < leader && votes[leader] - votes[i] <= remaining) || (i > leader && votes[leader] - votes[i] < remaining)) {
+                isDecided = false;
+            }
+        }
+
+        if (!isDecided && m_hp->earlyExitDelta > 0.0) {
+            double margin = (votes[leader] - runnerUp) / numTreesUsed;
+            isDecided = margin > sqrt(2.0 * log(1.0 / m_hp->earlyExitDelta) / numTreesUsed);
+        }
+
+        return isDecided;
+    }
 };
 
 #endif /* ONLINERF_H_ */
@@ -14,17 +14,43 @@ using namespace std;
 class OnlineTree: public Classifier {
 public:
     OnlineTree(const Hyperparameters &hp, const int &numClasses, const int &numFeatures, const vector<double> &minFeatRange,
-	  	       const vector<double> &maxFeatRange, int enableGP) :
-	m_counter(0.0), m_hp(&hp) {
-		m_rootNode = new OnlineNode(hp, numClasses, numFeatures, minFeatRange, maxFeatRange, 0, enableGP);
+	  	       const vector<double> &maxFeatRange, int enableGP, GPLeafBudget *gpBudget = NULL) :
+	m_numClasses(&numClasses), m_counter(0.0), m_hp(&hp), m_ownsGPBudget(gpBudget == NULL), m_isFrozen(false) {
+		// a standalone tree has its own GP budget, the trees of a forest share one
+		m_gpBudget = (m_ownsGPBudget) ? new GPLeafBudget(hp) : gpBudget;
+		m_rootNode = new OnlineNode(hp, numClasses, numFeatures, minFeatRange, maxFeatRange, 0, enableGP, m_gpBudget);
 	}
 
 	~OnlineTree() {
 		delete m_rootNode;
+		if (m_ownsGPBudget) {
+			delete m_gpBudget;
+		}
 	}
 
     virtual void update(Sample &sample) {
-        m_rootNode->update(sample);
+        update(sample, 1);
+    }
+
+    //! Same as numCopies calls of update(sample), with a single pass through the tree
+    void update(Sample &sample, const int &numCopies) {
+        if (m_isFrozen) {
+            cout << "Can not update a frozen Online Random Tree." << endl;
+            exit(EXIT_FAILURE);
+        }
+        m_rootNode->update(sample, numCopies);
+    }
+
+    //! Strips the training state, returns the number of bytes reclaimed
+    long freeze() {
+        long numBytes = memoryUsage();
+        m_rootNode->freeze();
+        m_isFrozen = true;
+        return numBytes - memoryUsage();
+    }
+
+    long memoryUsage() const {
+        return sizeof(OnlineTree) + m_rootNode->memoryUsage();
     }
 
     virtual void train(DataSet &dataset) {
@@ -46,10 +72,30 @@ public:
         return m_rootNode->eval(sample);
     }
 
+    //! Adds weight times the leaf distribution to confidence and returns the prediction
+    int eval(Sample &sample, vector<double> &confidence, const double &weight) {
+        return m_rootNode->eval(sample, confidence, weight);
+    }
+
+    //! eval() of a batch of samples, see OnlineNode::evalBatch
+    void evalBatch(const vector<Sample*> &samples, vector<vector<double> > &confidences, const double &weight,
+                   vector<int> &predictions) {
+        m_rootNode->evalBatch(samples, confidences, weight, predictions);
+    }
+
     virtual vector<Result> test(DataSet &dataset) {
-        vector<Result> results;
+        vector<Sample*> samples;
+        vector<vector<double> > confidences(dataset.m_numSamples, vector<double>(*m_numClasses, 0.0));
+        vector<int> predictions;
         for (int i = 0; i < dataset.m_numSamples; i++) {
-            results.push_back(eval(dataset.m_samples[i]));
+            samples.push_back(&dataset.m_samples[i]);
+        }
+        evalBatch(samples, confidences, 1.0, predictions);
+
+        vector<Result> results(dataset.m_numSamples);
+        for (int i = 0; i < dataset.m_numSamples; i++) {
+            results[i].prediction = predictions[i];
+            results[i].confidence.swap(confidences[i]);
         }
 
         double error = compError(results, dataset);
@@ -88,10 +134,16 @@ public:
     }
 
 private:
+    friend class CodeExporter;
+
+    const int *m_numClasses;
     double m_counter;
     const Hyperparameters *m_hp;
 
     OnlineNode* m_rootNode;
+    GPLeafBudget *m_gpBudget;
+    bool m_ownsGPBudget;
+    bool m_isFrozen;
 };
 
 #endif /* ONLINETREE_H_ */
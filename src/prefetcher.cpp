@@ -0,0 +1,89 @@
+#include <chrono>
+
+#include "prefetcher.h"
+
+using namespace std;
+
+ChunkPrefetcher::ChunkPrefetcher(ChunkedDataFile &dataFile, const int &numBuffers) :
+    m_dataFile(&dataFile), m_buffers(numBuffers), m_numReturned(0), m_waitTime(0.0), m_stopping(false) {
+}
+
+void ChunkPrefetcher::start(const vector<int> &chunkOrder) {
+    stop();
+
+    m_chunkOrder = chunkOrder;
+    m_numReturned = 0;
+    m_stopping = false;
+    m_free.clear();
+    m_full.clear();
+    for (int i = 0; i < (int) m_buffers.size(); i++) {
+        m_free.push_back(&m_buffers[i]);
+    }
+
+    m_reader = thread(&ChunkPrefetcher::read, this);
+}
+
+void ChunkPrefetcher::stop() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cond.notify_all();
+
+    if (m_reader.joinable()) {
+        m_reader.join();
+    }
+}
+
+void ChunkPrefetcher::read() {
+    for (int c = 0; c < (int) m_chunkOrder.size(); c++) {
+        vector<Sample> *chunk;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            while (m_free.empty() && !m_stopping) {
+                m_cond.wait(lock);
+            }
+            if (m_stopping) {
+                return;
+            }
+            chunk = m_free.front();
+            m_free.pop_front();
+        }
+
+        // The file is only touched by this thread
+        m_dataFile->readChunk(m_chunkOrder[c], *chunk);
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_full.push_back(chunk);
+        }
+        m_cond.notify_all();
+    }
+}
+
+vector<Sample>* ChunkPrefetcher::next() {
+    if (m_numReturned == (int) m_chunkOrder.size()) {
+        return NULL;
+    }
+
+    chrono::steady_clock::time_point waitStart = chrono::steady_clock::now();
+
+    unique_lock<mutex> lock(m_mutex);
+    while (m_full.empty()) {
+        m_cond.wait(lock);
+    }
+    vector<Sample> *chunk = m_full.front();
+    m_full.pop_front();
+    m_numReturned++;
+
+    m_waitTime += chrono::duration<double, milli>(chrono::steady_clock::now() - waitStart).count();
+    return chunk;
+}
+
+void ChunkPrefetcher::release(vector<Sample> *chunk) {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_free.push_back(chunk);
+    }
+    m_cond.notify_all();
+}
@@ -0,0 +1,60 @@
+#ifndef PREFETCHER_H_
+#define PREFETCHER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "data.h"
+
+using namespace std;
+
+//! Reads the chunks of a ChunkedDataFile on a background thread while the caller trains on
+//! the previous ones. There are numBuffers chunk buffers. The reader waits for the trainer
+//! to release one before it reads ahead, so at most numBuffers chunks are in memory.
+class ChunkPrefetcher {
+public:
+    ChunkPrefetcher(ChunkedDataFile &dataFile, const int &numBuffers = 2);
+
+    ~ChunkPrefetcher() {
+        stop();
+    }
+
+    //! Starts reading the chunks in the given order, after the previous pass has been stopped
+    void start(const vector<int> &chunkOrder);
+
+    //! Returns the next chunk in order, waits until it has been read. Returns NULL once all
+    //! chunks of the pass have been returned.
+    vector<Sample>* next();
+
+    //! Gives a chunk returned by next() back to the reader
+    void release(vector<Sample> *chunk);
+
+    //! Stops the reader and joins it
+    void stop();
+
+    //! Time the trainer spent waiting in next() for the reader, in ms
+    double waitTime() const {
+        return m_waitTime;
+    }
+
+private:
+    ChunkedDataFile *m_dataFile;
+    vector<vector<Sample> > m_buffers;
+    vector<int> m_chunkOrder;
+    int m_numReturned;
+    double m_waitTime;
+
+    mutex m_mutex;
+    condition_variable m_cond;
+    deque<vector<Sample>*> m_free;
+    deque<vector<Sample>*> m_full;
+    bool m_stopping;
+    thread m_reader;
+
+    void read();
+};
+
+#endif /* PREFETCHER_H_ */
@@ -1,6 +1,7 @@
 #ifndef RANDOMTEST_H_
 #define RANDOMTEST_H_
 
+#include "classhistogram.h"
 #include "data.h"
 #include "utilities.h"
 
@@ -11,30 +12,22 @@ public:
     }
 
     RandomTest(const int &numClasses) :
-        m_numClasses(&numClasses), m_trueCount(0.0), m_falseCount(0.0) {
-        for (int i = 0; i < numClasses; i++) {
-            m_trueStats.push_back(0.0);
-            m_falseStats.push_back(0.0);
-        }
+        m_numClasses(&numClasses), m_trueCount(0.0), m_falseCount(0.0), m_trueStats(numClasses), m_falseStats(numClasses) {
         m_threshold = randomFromRange(-1, 1);
     }
 
     RandomTest(const int &numClasses, const double featMin, const double featMax) :
-        m_numClasses(&numClasses), m_trueCount(0.0), m_falseCount(0.0) {
-        for (int i = 0; i < numClasses; i++) {
-            m_trueStats.push_back(0.0);
-            m_falseStats.push_back(0.0);
-        }
+        m_numClasses(&numClasses), m_trueCount(0.0), m_falseCount(0.0), m_trueStats(numClasses), m_falseStats(numClasses) {
         m_threshold = randomFromRange(featMin, featMax);
     }
 
-    void updateStats(const Sample &sample, const bool decision) {
+    void updateStats(const Sample &sample, const bool decision, const double &weight) {
         if (decision) {
-            m_trueCount += sample.w;
-            m_trueStats[sample.y] += sample.w;
+            m_trueCount += weight;
+            m_trueStats.add(sample.y, weight);
         } else {
-            m_falseCount += sample.w;
-            m_falseStats[sample.y] += sample.w;
+            m_falseCount += weight;
+            m_falseStats.add(sample.y, weight);
         }
     }
 
@@ -53,31 +46,15 @@ public:
         }
 
         // Prior Entropy
-        double priorEntropy = 0.0;
-        for (int i = 0; i < *m_numClasses; i++) {
-            p = (m_trueStats[i] + m_falseStats[i]) / totalCount;
-            if (p) {
-                priorEntropy -= p * log2(p);
-            }
-        }
+        double priorEntropy = ClassHistogram::entropy(m_trueStats, m_falseStats, totalCount);
 
-        // Posterior Entropy
+        // Posterior Entropy, only over the classes that were seen
         double trueScore = 0.0, falseScore = 0.0;
         if (m_trueCount) {
-            for (int i = 0; i < *m_numClasses; i++) {
-                p = m_trueStats[i] / m_trueCount;
-                if (p) {
-                    trueScore -= p * log2(p);
-                }
-            }
+            trueScore = m_trueStats.entropy(m_trueCount);
         }
         if (m_falseCount) {
-            for (int i = 0; i < *m_numClasses; i++) {
-                p = m_falseStats[i] / m_falseCount;
-                if (p) {
-                    falseScore -= p * log2(p);
-                }
-            }
+            falseScore = m_falseStats.entropy(m_falseCount);
         }
         double posteriorEntropy = (m_trueCount * trueScore + m_falseCount * falseScore) / totalCount;
 
@@ -85,8 +62,18 @@ public:
         return (2.0 * (priorEntropy - posteriorEntropy)) / (priorEntropy * splitEntropy + 1e-10);
     }
 
-    pair<vector<double> , vector<double> > getStats() {
-        return pair<vector<double> , vector<double> > (m_trueStats, m_falseStats);
+    pair<ClassHistogram, ClassHistogram> getStats() {
+        return pair<ClassHistogram, ClassHistogram> (m_trueStats, m_falseStats);
+    }
+
+    //! Frees the split statistics, the test can only be evaluated afterwards
+    void freezeStats() {
+        m_trueStats.clear();
+        m_falseStats.clear();
+    }
+
+    long memoryUsage() const {
+        return m_trueStats.memoryUsage() + m_falseStats.memoryUsage();
     }
 
 protected:
@@ -94,8 +81,8 @@ protected:
     double m_threshold;
     double m_trueCount;
     double m_falseCount;
-    vector<double> m_trueStats;
-    vector<double> m_falseStats;
+    ClassHistogram m_trueStats;
+    ClassHistogram m_falseStats;
 };
 
 class HyperplaneFeature: public RandomTest {
@@ -105,7 +92,7 @@ public:
     }
 
     HyperplaneFeature(const int &numClasses, const int &numFeatures, const int &numProjFeatures, const vector<double> &minFeatRange,
-            const vector<double> &maxFeatRange) :
+            const vector<double> &maxFeatRange, const int &quantizeBits = 0) :
         RandomTest(numClasses), m_numProjFeatures(&numProjFeatures) {
         randPerm(numFeatures, numProjFeatures, m_features);
         fillWithRandomNumbers(numProjFeatures, m_weights);
@@ -118,25 +105,94 @@ public:
         }
 
         m_threshold = randomFromRange(minRange, maxRange);
+
+        // A quantized value q stands for min + q * (max - min) / levels, see DataSet::quantize. The
+        // offsets move into the threshold, so the projection is a plain weighted sum of the codes.
+        if (quantizeBits) {
+            double levels = (1 << quantizeBits) - 1;
+            m_quantThreshold = m_threshold - minRange;
+            for (int i = 0; i < numProjFeatures; i++) {
+                double step = (maxFeatRange[m_features[i]] - minFeatRange[m_features[i]]) / levels;
+                m_quantWeights.push_back(m_weights[i] * step);
+            }
+        }
+    }
+
+    //! Adds the sample with the given weight, usually sample.w
+    void update(Sample &sample, const double &weight) {
+        updateStats(sample, eval(sample), weight);
+    }
+
+    //! Keeps only what eval needs
+    void freeze() {
+        freezeStats();
+        vector<int>(m_features.begin(), m_features.begin() + m_weights.size()).swap(m_features);
     }
 
-    void update(Sample &sample) {
-        updateStats(sample, eval(sample));
+    long memoryUsage() const {
+        return sizeof(HyperplaneFeature) + RandomTest::memoryUsage() + m_features.capacity() * sizeof(int)
+                + (m_weights.capacity() + m_quantWeights.capacity()) * sizeof(double);
+    }
+
+    //! Fetches the weights and features eval will read into the cache
+    void prefetch() const {
+        prefetchRead(m_features.data());
+        prefetchRead((m_quantWeights.empty()) ? m_weights.data() : m_quantWeights.data());
     }
 
     bool eval(Sample &sample) {
+        if (sample.quant8 != NULL) {
+            return projectQuantized(sample.quant8) > m_quantThreshold;
+        } else if (sample.quant16 != NULL) {
+            return projectQuantized(sample.quant16) > m_quantThreshold;
+        }
+
         double proj = 0.0;
-        for (int i = 0; i < *m_numProjFeatures; i++) {
-            proj += sample.x[m_features[i]] * m_weights[i];
+        if (!sample.bits.empty()) {
+            // Binary sample: sum the weights of the set features
+            for (int i = 0; i < *m_numProjFeatures; i++) {
+                if (sample.hasBit(m_features[i])) {
+                    proj += m_weights[i];
+                }
+            }
+        } else if (!sample.ones.empty()) {
+            for (int i = 0; i < *m_numProjFeatures; i++) {
+                if (binary_search(sample.ones.begin(), sample.ones.end(), m_features[i])) {
+                    proj += m_weights[i];
+                }
+            }
+        } else if (sample.dense != NULL) {
+            for (int i = 0; i < *m_numProjFeatures; i++) {
+                proj += sample.dense[m_features[i]] * m_weights[i];
+            }
+        } else {
+            for (int i = 0; i < *m_numProjFeatures; i++) {
+                proj += sample.x[m_features[i]] * m_weights[i];
+            }
         }
 
         return (proj > m_threshold) ? true : false;
     }
 
 private:
+    friend class CodeExporter;
+
     const int *m_numProjFeatures;
     vector<int> m_features;
     vector<double> m_weights;
+
+    // Weights and threshold in the space of the quantized features
+    vector<double> m_quantWeights;
+    double m_quantThreshold;
+
+    template<class T>
+    double projectQuantized(const T *row) const {
+        double proj = 0.0;
+        for (int i = 0; i < *m_numProjFeatures; i++) {
+            proj += m_quantWeights[i] * row[m_features[i]];
+        }
+        return proj;
+    }
 };
 
 #endif /* RANDOMTEST_H_ */
@@ -0,0 +1,132 @@
+#include "sparsekern.h"
+
+#include <cmath>
+
+
+/**
+ * Dot product of two sparse vectors, merging their sorted index lists.
+ */
+static double sparse_dot(const SparseVector& x, const SparseVector& y) {
+	double result = 0.0;
+
+	SparseVector::const_iterator ix = x.begin(), iy = y.begin();
+	while(ix != x.end() && iy != y.end()) {
+		if(ix.index() < iy.index())
+			ix++;
+		else if(iy.index() < ix.index())
+			iy++;
+		else {
+			result += (*ix) * (*iy);
+			ix++;
+			iy++;
+		}
+	}
+
+	return result;
+}
+
+
+unsigned int SparseSampleTable::add(const SparseVector& x) {
+	// a new training row invalidates the query ids
+	query_rows.clear();
+	sq_norms.resize(train_rows.size());
+
+	train_rows.push_back(x);
+	sq_norms.push_back(sparse_dot(x, x));
+	n_bytes += sizeof(SparseVector) + sizeof(double) + x.nb_stored() * sizeof(elt_rsvector_<double>);
+
+	return train_rows.size() - 1;
+}
+
+unsigned int SparseSampleTable::set_query(unsigned int q, const SparseVector& x) {
+	if(q >= query_rows.size()) {
+		query_rows.resize(q + 1);
+		sq_norms.resize(train_rows.size() + q + 1);
+	}
+
+	query_rows[q] = &x;
+	sq_norms[train_rows.size() + q] = sparse_dot(x, x);
+
+	return train_rows.size() + q;
+}
+
+const SparseVector& SparseSampleTable::row(unsigned int id) const {
+	return (id < train_rows.size()) ? train_rows[id] : *query_rows[id - train_rows.size()];
+}
+
+double SparseSampleTable::dist2(unsigned int id1, unsigned int id2) const {
+	if(id1 == id2)
+		return 0.0;
+
+	double result = sq_norms[id1] + sq_norms[id2] - 2.0 * sparse_dot(row(id1), row(id2));
+
+	// cancellation can make the difference slightly negative
+	return (result > 0.0) ? result : 0.0;
+}
+
+
+CSparseRbfKern::CSparseRbfKern(const SparseSampleTable* table) : CRbfKern(1) {
+	this->table = table;
+}
+
+double CSparseRbfKern::computeElement(const CMatrix& X1, unsigned int index1, const CMatrix& X2, unsigned int index2) const {
+	return getParam(1) * exp(-0.5 * getParam(0) * dist2(X1, index1, X2, index2));
+}
+
+void CSparseRbfKern::compute(CMatrix& K, const CMatrix& X, const CMatrix& X2) const {
+	for(unsigned int i=0; i<X.getRows(); i++) {
+		for(unsigned int j=0; j<X2.getRows(); j++) {
+			K.setVal(computeElement(X, i, X2, j), i, j);
+		}
+	}
+}
+
+void CSparseRbfKern::compute(CMatrix& K, const CMatrix& X) const {
+	for(unsigned int i=0; i<X.getRows(); i++) {
+		K.setVal(getParam(1), i, i);
+		for(unsigned int j=0; j<i; j++) {
+			double k = computeElement(X, i, X, j);
+			K.setVal(k, i, j);
+			K.setVal(k, j, i);
+		}
+	}
+}
+
+/**
+ * Gradient of the parameters, with dk/d(inverse width) = -0.5 d^2 k and
+ * dk/d(variance) = k / variance.
+ */
+void CSparseRbfKern::getGradParams(CMatrix& g, const CMatrix& X, const CMatrix& X2, const CMatrix& covGrad, bool regularise) const {
+	double variance = getParam(1);
+	double inverse_width = getParam(0);
+	double g_width = 0.0, g_variance = 0.0;
+
+	for(unsigned int i=0; i<X.getRows(); i++) {
+		for(unsigned int j=0; j<X2.getRows(); j++) {
+			double d2 = dist2(X, i, X2, j);
+			double k = exp(-0.5 * inverse_width * d2);
+			g_width -= 0.5 * covGrad.getVal(i, j) * variance * k * d2;
+			g_variance += covGrad.getVal(i, j) * k;
+		}
+	}
+
+	g.setVal(g_width, 0, 0);
+	g.setVal(g_variance, 0, 1);
+
+	if(regularise)
+		addPriorGrad(g);
+}
+
+void CSparseRbfKern::getGradParams(CMatrix& g, const CMatrix& X, const CMatrix& covGrad, bool regularise) const {
+	getGradParams(g, X, X, covGrad, regularise);
+}
+
+double CSparseRbfKern::getGradParam(unsigned int index, const CMatrix& X, const CMatrix& X2, const CMatrix& covGrad) const {
+	CMatrix g(1, getNumParams());
+	getGradParams(g, X, X2, covGrad, false);
+	return g.getVal(0, index);
+}
+
+double CSparseRbfKern::getGradParam(unsigned int index, const CMatrix& X, const CMatrix& covGrad) const {
+	return getGradParam(index, X, X, covGrad);
+}
@@ -0,0 +1,78 @@
+#ifndef SPARSEKERN_HPP
+#define SPARSEKERN_HPP
+
+#include "data.h"
+
+#include <gp-lvm/CKern.h>
+#include <gp-lvm/CMatrix.h>
+
+#include <vector>
+
+
+/**
+ * Sparse samples with cached squared norms, addressed by a row id.
+ *
+ * The training rows are copied into the table. The query rows follow
+ * the training rows and only point to the caller's samples, they are
+ * overwritten by every prediction.
+ */
+class SparseSampleTable {
+public:
+	SparseSampleTable() : n_bytes(0) {}
+
+	// append a training row, returns its id
+	unsigned int add(const SparseVector& x);
+	unsigned int size() const { return train_rows.size(); }
+
+	const SparseVector& get(unsigned int id) const { return row(id); }
+
+	// point query row 'q' to 'x', returns its id
+	unsigned int set_query(unsigned int q, const SparseVector& x);
+
+	// squared euclidean distance between two rows, O(nnz)
+	double dist2(unsigned int id1, unsigned int id2) const;
+
+	long memory_usage() const { return n_bytes; }
+private:
+	std::vector<SparseVector> train_rows;
+	std::vector<const SparseVector*> query_rows;
+	std::vector<double> sq_norms;
+	long n_bytes;
+
+	const SparseVector& row(unsigned int id) const;
+};
+
+
+/**
+ * RBF kernel on sparse samples.
+ *
+ * The input matrices handed to the IVM have a single column holding
+ * row ids of a SparseSampleTable. Squared distances are computed as
+ * |x|^2 + |y|^2 - 2 x'y from the cached norms and a sparse dot product,
+ * so the kernel cost scales with the number of non-zeros instead of
+ * the input dimension. The parameters are the ones of CRbfKern:
+ * 0 is the inverse width, 1 is the variance.
+ */
+class CSparseRbfKern : public CRbfKern {
+public:
+	CSparseRbfKern(const SparseSampleTable* table);
+
+	CSparseRbfKern* clone() const { return new CSparseRbfKern(*this); }
+
+	double computeElement(const CMatrix& X1, unsigned int index1, const CMatrix& X2, unsigned int index2) const;
+	void compute(CMatrix& K, const CMatrix& X, const CMatrix& X2) const;
+	void compute(CMatrix& K, const CMatrix& X) const;
+
+	void getGradParams(CMatrix& g, const CMatrix& X, const CMatrix& X2, const CMatrix& covGrad, bool regularise=true) const;
+	void getGradParams(CMatrix& g, const CMatrix& X, const CMatrix& covGrad, bool regularise=true) const;
+	double getGradParam(unsigned int index, const CMatrix& X, const CMatrix& X2, const CMatrix& covGrad) const;
+	double getGradParam(unsigned int index, const CMatrix& X, const CMatrix& covGrad) const;
+private:
+	const SparseSampleTable* table;
+
+	double dist2(const CMatrix& X1, unsigned int index1, const CMatrix& X2, unsigned int index2) const {
+		return table->dist2((unsigned int) X1.getVal(index1, 0), (unsigned int) X2.getVal(index2, 0));
+	}
+};
+
+#endif
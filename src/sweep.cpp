@@ -0,0 +1,195 @@
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <libconfig.h++>
+
+#include "onlinerf.h"
+#include "sweep.h"
+#include "workerpool.h"
+
+using namespace std;
+using namespace libconfig;
+
+// The settings a sweep can vary, in the order of the columns of the result table
+static const int NUM_SWEEP_SETTINGS = 5;
+static const char *SWEEP_SETTINGS[NUM_SWEEP_SETTINGS] = { "numTrees", "maxDepth", "numRandomTests", "numProjectionFeatures",
+                                                          "counterThreshold" };
+
+static int& sweepSetting(Hyperparameters &hp, const int &setting) {
+    switch (setting) {
+    case 0:
+        return hp.numTrees;
+    case 1:
+        return hp.maxDepth;
+    case 2:
+        return hp.numRandomTests;
+    case 3:
+        return hp.numProjectionFeatures;
+    default:
+        return hp.counterThreshold;
+    }
+}
+
+vector<Hyperparameters> loadSweep(const Hyperparameters &base, const string &sweepFile, int &numParallel) {
+    cout << "Loading sweep file: " << sweepFile << " ... ";
+
+    Config configFile;
+    configFile.readFile(sweepFile.c_str());
+
+    int grid = configFile.lookup("Sweep.grid");
+    numParallel = configFile.lookup("Sweep.numParallel");
+
+    vector<vector<int> > values(NUM_SWEEP_SETTINGS);
+    for (int s = 0; s < NUM_SWEEP_SETTINGS; s++) {
+        const Setting &list = configFile.lookup(string("Sweep.") + SWEEP_SETTINGS[s]);
+        for (int i = 0; i < list.getLength(); i++) {
+            values[s].push_back(list[i]);
+        }
+        if (values[s].empty()) {
+            cout << "Sweep." << SWEEP_SETTINGS[s] << " needs at least one value." << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    vector<Hyperparameters> candidates;
+    if (grid) {
+        // Counts through the combinations like an odometer, the last setting changes fastest
+        vector<int> index(NUM_SWEEP_SETTINGS, 0);
+        while (index[0] < (int) values[0].size()) {
+            Hyperparameters hp = base;
+            for (int s = 0; s < NUM_SWEEP_SETTINGS; s++) {
+                sweepSetting(hp, s) = values[s][index[s]];
+            }
+            candidates.push_back(hp);
+
+            int s = NUM_SWEEP_SETTINGS - 1;
+            index[s]++;
+            while (s > 0 && index[s] == (int) values[s].size()) {
+                index[s--] = 0;
+                index[s]++;
+            }
+        }
+    } else {
+        int numCandidates = 1;
+        for (int s = 0; s < NUM_SWEEP_SETTINGS; s++) {
+            if (values[s].size() > 1) {
+                if (numCandidates > 1 && (int) values[s].size() != numCandidates) {
+                    cout << "The lists of a sweep with grid = 0 need the same length or a single value." << endl;
+                    exit(EXIT_FAILURE);
+                }
+                numCandidates = values[s].size();
+            }
+        }
+        for (int i = 0; i < numCandidates; i++) {
+            Hyperparameters hp = base;
+            for (int s = 0; s < NUM_SWEEP_SETTINGS; s++) {
+                sweepSetting(hp, s) = values[s][(values[s].size() > 1) ? i : 0];
+            }
+            candidates.push_back(hp);
+        }
+    }
+
+    cout << "Done, " << candidates.size() << " candidates." << endl;
+    return candidates;
+}
+
+//! Trains and tests the forest of one candidate
+class SweepJob: public Job {
+public:
+    SweepJob(const Hyperparameters &candidate) :
+        hp(candidate), result(candidate) {
+        // The forests already run in parallel, and they would all talk at once
+        hp.numTreeWorkers = 0;
+        hp.verbose = 0;
+    }
+
+    Hyperparameters hp;
+    DataSet *trainSet;
+    DataSet *testSet;
+    const vector<vector<int> > *epochOrders;
+    SweepResult result;
+
+    virtual void run() {
+        OnlineRF forest(hp, trainSet->m_numClasses, trainSet->m_numFeatures, trainSet->m_minFeatRange,
+                        trainSet->m_maxFeatRange, 0);
+
+        Clock::time_point startTime = Clock::now();
+        long numUpdates = 0;
+        for (int n = 0; n < (int) epochOrders->size(); n++) {
+            const vector<int> &order = (*epochOrders)[n];
+            for (int i = 0; i < (int) order.size(); i++) {
+                forest.update(trainSet->m_samples[order[i]]);
+            }
+            numUpdates += order.size();
+        }
+
+        result.trainTime = chrono::duration<double> (Clock::now() - startTime).count();
+        result.samplesPerSecond = (result.trainTime > 0.0) ? numUpdates / result.trainTime : 0.0;
+        result.memoryUsage = forest.memoryUsage();
+        result.testError = forest.compError(forest.test(*testSet), *testSet);
+    }
+};
+
+vector<SweepResult> runSweep(const vector<Hyperparameters> &candidates, DataSet &trainSet, DataSet &testSet,
+                             const int &numParallel) {
+    int numThreads = (numParallel > 0) ? numParallel : max((int) thread::hardware_concurrency(), 1);
+    numThreads = min(numThreads, (int) candidates.size());
+
+    // The same sample stream for every candidate
+    vector<vector<int> > epochOrders(candidates.empty() ? 0 : candidates[0].numEpochs);
+    for (int n = 0; n < (int) epochOrders.size(); n++) {
+        randPerm(trainSet.m_numSamples, epochOrders[n]);
+    }
+
+    vector<SweepJob*> jobs;
+    for (int i = 0; i < (int) candidates.size(); i++) {
+        SweepJob *job = new SweepJob(candidates[i]);
+        job->trainSet = &trainSet;
+        job->testSet = &testSet;
+        job->epochOrders = &epochOrders;
+        jobs.push_back(job);
+    }
+
+    cout << "--- Hyperparameter sweep: " << candidates.size() << " candidates, " << numThreads << " at a time" << endl;
+    Clock::time_point startTime = Clock::now();
+    WorkerPool pool;
+    pool.start(numThreads);
+    for (int i = 0; i < (int) jobs.size(); i++) {
+        pool.submit(jobs[i]);
+    }
+
+    vector<SweepResult> results;
+    for (int i = 0; i < (int) jobs.size(); i++) {
+        jobs[i]->wait();
+        results.push_back(jobs[i]->result);
+        delete jobs[i];
+    }
+    pool.stop();
+
+    int best = 0;
+    cout << setw(4) << "#";
+    for (int s = 0; s < NUM_SWEEP_SETTINGS; s++) {
+        cout << setw(strlen(SWEEP_SETTINGS[s]) + 2) << SWEEP_SETTINGS[s];
+    }
+    cout << setw(12) << "test error" << setw(14) << "samples/s" << setw(12) << "memory KB" << endl;
+    for (int i = 0; i < (int) results.size(); i++) {
+        cout << setw(4) << i + 1;
+        for (int s = 0; s < NUM_SWEEP_SETTINGS; s++) {
+            cout << setw(strlen(SWEEP_SETTINGS[s]) + 2) << sweepSetting(results[i].hp, s);
+        }
+        cout << setw(12) << results[i].testError << setw(14) << (long) results[i].samplesPerSecond;
+        cout << setw(12) << results[i].memoryUsage / 1024 << endl;
+
+        if (results[i].testError < results[best].testError) {
+            best = i;
+        }
+    }
+    if (!results.empty()) {
+        cout << "--- Lowest test error: candidate " << best + 1 << ", sweep time: ";
+        cout << chrono::duration<double> (Clock::now() - startTime).count() << " s" << endl;
+    }
+
+    return results;
+}
@@ -0,0 +1,39 @@
+#ifndef SWEEP_H_
+#define SWEEP_H_
+
+#include <string>
+#include <vector>
+
+#include "data.h"
+#include "hyperparameters.h"
+
+using namespace std;
+
+//! A forest configuration of a hyperparameter sweep and how it did
+class SweepResult {
+public:
+    explicit SweepResult(const Hyperparameters &hp) :
+        hp(hp), testError(1.0), trainTime(0.0), samplesPerSecond(0.0), memoryUsage(0) {
+    }
+
+    Hyperparameters hp;
+    double testError;
+    double trainTime; // seconds
+    double samplesPerSecond; // training updates per second, over all epochs
+    long memoryUsage; // bytes of the trained trees
+};
+
+//! Reads the candidates of a sweep file. Every candidate is a copy of base with numTrees,
+//! maxDepth, numRandomTests, numProjectionFeatures and counterThreshold taken from the lists
+//! of the file's Sweep section: with grid = 1 every combination of the listed values, with
+//! grid = 0 the i-th value of every list (lists of length 1 apply to all candidates).
+//! numParallel is the number of forests to train at the same time, 0 for one per CPU.
+vector<Hyperparameters> loadSweep(const Hyperparameters &base, const string &sweepFile, int &numParallel);
+
+//! Trains a forest for every candidate on numParallel threads. All forests see the training
+//! samples in the same order, the data is shared and never copied. Prints a table of the
+//! results and returns them in the order of the candidates.
+vector<SweepResult> runSweep(const vector<Hyperparameters> &candidates, DataSet &trainSet, DataSet &testSet,
+                             const int &numParallel);
+
+#endif /* SWEEP_H_ */
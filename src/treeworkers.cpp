@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "treeworkers.h"
+
+using namespace std;
+
+//! Parses a sysfs list such as "0-3,8-11"
+static vector<int> parseCpuList(const string &list) {
+    vector<int> values;
+    stringstream ss(list);
+    string range;
+    while (getline(ss, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        int first, last;
+        size_t dash = range.find('-');
+        first = atoi(range.substr(0, dash).c_str());
+        last = (dash == string::npos) ? first : atoi(range.substr(dash + 1).c_str());
+        for (int i = first; i <= last; i++) {
+            values.push_back(i);
+        }
+    }
+    return values;
+}
+
+static bool readLine(const string &fileName, string &line) {
+    ifstream file(fileName.c_str());
+    if (!file) {
+        return false;
+    }
+    getline(file, line);
+    return true;
+}
+
+NumaTopology::NumaTopology() {
+    string line;
+    if (readLine("/sys/devices/system/node/online", line)) {
+        vector<int> nodes = parseCpuList(line);
+        for (int i = 0; i < (int) nodes.size(); i++) {
+            stringstream fileName;
+            fileName << "/sys/devices/system/node/node" << nodes[i] << "/cpulist";
+            // Nodes with memory but without CPUs can not run a worker
+            if (readLine(fileName.str(), line) && !parseCpuList(line).empty()) {
+                m_nodeCpus.push_back(parseCpuList(line));
+            }
+        }
+    }
+
+    if (m_nodeCpus.empty()) {
+        int numCpus = max((int) thread::hardware_concurrency(), 1);
+        m_nodeCpus.push_back(vector<int> ());
+        for (int i = 0; i < numCpus; i++) {
+            m_nodeCpus[0].push_back(i);
+        }
+    }
+}
+
+//! Restricts the calling thread to the given CPUs
+static void pinCurrentThread(const vector<int> &cpus) {
+#ifdef __linux__
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int i = 0; i < (int) cpus.size(); i++) {
+        CPU_SET(cpus[i], &cpuSet);
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet)) {
+        cout << "Warning: could not pin a tree worker to its NUMA node." << endl;
+    }
+#endif
+}
+
+TreeWorkers::TreeWorkers(const int &numWorkers, const int &numTrees, const int &placement) :
+    m_task(NULL), m_stealPolicy(STEAL_NONE), m_generation(0), m_numRunning(0), m_stopping(false), m_numStolen(0),
+            m_numTasks(0) {
+    // Equal blocks of trees, the first workers get one more if they do not divide evenly
+    m_firstTree.push_back(0);
+    for (int i = 0; i < numWorkers; i++) {
+        m_firstTree.push_back(m_firstTree[i] + numTrees / numWorkers + ((i < numTrees % numWorkers) ? 1 : 0));
+    }
+
+    int numNodes = m_topology.numNodes();
+    int workersPerNode = (numWorkers + numNodes - 1) / numNodes;
+    for (int i = 0; i < numWorkers; i++) {
+        switch (placement) {
+        case PLACEMENT_SPREAD:
+            m_workerNodes.push_back(i % numNodes);
+            break;
+        case PLACEMENT_COMPACT:
+            m_workerNodes.push_back(i / workersPerNode);
+            break;
+        default:
+            m_workerNodes.push_back(-1);
+            break;
+        }
+    }
+
+    // Stealing from the own node first keeps the trees in the memory of the socket
+    for (int i = 0; i < numWorkers; i++) {
+        m_queues.push_back(new TaskQueue());
+        m_victims.push_back(vector<int> ());
+        for (int sameNode = 1; sameNode >= 0; sameNode--) {
+            for (int j = 1; j < numWorkers; j++) {
+                int victim = (i + j) % numWorkers;
+                if ((m_workerNodes[victim] == m_workerNodes[i]) == (sameNode == 1)) {
+                    m_victims[i].push_back(victim);
+                }
+            }
+            if (sameNode) {
+                m_numSameNodeVictims.push_back(m_victims[i].size());
+            }
+        }
+    }
+
+    for (int i = 0; i < numWorkers; i++) {
+        m_threads.push_back(thread(&TreeWorkers::work, this, i));
+    }
+}
+
+TreeWorkers::~TreeWorkers() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_startCond.notify_all();
+
+    for (int i = 0; i < (int) m_threads.size(); i++) {
+        m_threads[i].join();
+    }
+    for (int i = 0; i < (int) m_queues.size(); i++) {
+        delete m_queues[i];
+    }
+}
+
+void TreeWorkers::run(TreeTask &task, const int &stealPolicy) {
+    unique_lock<mutex> lock(m_mutex);
+    for (int i = 0; i < numWorkers(); i++) {
+        lock_guard<mutex> queueLock(m_queues[i]->m_mutex);
+        for (int tree = firstTree(i); tree < lastTree(i); tree++) {
+            m_queues[i]->m_trees.push_back(tree);
+        }
+    }
+    m_numTasks += lastTree(numWorkers() - 1);
+
+    m_task = &task;
+    m_stealPolicy = stealPolicy;
+    m_numRunning = numWorkers();
+    m_generation++;
+    m_startCond.notify_all();
+
+    while (m_numRunning) {
+        m_doneCond.wait(lock);
+    }
+    m_task = NULL;
+}
+
+//! The owner works from the front of its deque
+bool TreeWorkers::popOwn(const int &worker, int &tree) {
+    TaskQueue *queue = m_queues[worker];
+    lock_guard<mutex> lock(queue->m_mutex);
+    if (queue->m_trees.empty()) {
+        return false;
+    }
+    tree = queue->m_trees.front();
+    queue->m_trees.pop_front();
+    return true;
+}
+
+//! Thieves take from the back, away from the trees the owner is about to visit
+bool TreeWorkers::steal(const int &worker, const int &stealPolicy, int &tree) {
+    int numVictims = (stealPolicy == STEAL_ANY) ? m_victims[worker].size() : m_numSameNodeVictims[worker];
+    for (int i = 0; i < numVictims; i++) {
+        TaskQueue *queue = m_queues[m_victims[worker][i]];
+        lock_guard<mutex> lock(queue->m_mutex);
+        if (!queue->m_trees.empty()) {
+            tree = queue->m_trees.back();
+            queue->m_trees.pop_back();
+            m_numStolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TreeWorkers::work(const int worker) {
+    if (m_workerNodes[worker] >= 0) {
+        pinCurrentThread(m_topology.cpus(m_workerNodes[worker]));
+    }
+
+    long generation = 0;
+    while (true) {
+        TreeTask *task;
+        int stealPolicy;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            while (!m_stopping && m_generation == generation) {
+                m_startCond.wait(lock);
+            }
+            if (m_stopping) {
+                return;
+            }
+            generation = m_generation;
+            task = m_task;
+            stealPolicy = m_stealPolicy;
+        }
+
+        // No task creates new ones, so once all deques are empty the run is over
+        int tree;
+        while (popOwn(worker, tree) || (stealPolicy != STEAL_NONE && steal(worker, stealPolicy, tree))) {
+            task->run(worker, tree);
+        }
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_numRunning--;
+        }
+        m_doneCond.notify_all();
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef TREEWORKERS_H_
+#define TREEWORKERS_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//! How the tree workers are placed on the NUMA nodes (sockets) of the machine
+typedef enum {
+    PLACEMENT_NONE = 0, // workers are not pinned, the trees are built by the calling thread
+    PLACEMENT_SPREAD = 1, // worker i runs on node i % numNodes
+    PLACEMENT_COMPACT = 2 // the workers fill one node before using the next
+} TreePlacement;
+
+//! Which trees an idle worker may take over from other workers during a run
+typedef enum {
+    STEAL_NONE = 0, // every tree is handled by its owner
+    STEAL_SAME_NODE = 1, // only trees of workers on the same NUMA node
+    STEAL_ANY = 2 // trees of any worker, the own node first
+} StealPolicy;
+
+//! The CPUs of every NUMA node, read from sysfs. A machine without NUMA information is a
+//! single node with all online CPUs.
+class NumaTopology {
+public:
+    NumaTopology();
+
+    int numNodes() const {
+        return (int) m_nodeCpus.size();
+    }
+
+    const vector<int>& cpus(const int &node) const {
+        return m_nodeCpus[node];
+    }
+
+private:
+    vector<vector<int> > m_nodeCpus;
+};
+
+//! Work on one tree, run by whichever worker picks the tree up
+class TreeTask {
+public:
+    virtual ~TreeTask() {
+    }
+
+    virtual void run(const int &worker, const int &tree) = 0;
+};
+
+//! Threads that each own a contiguous block of the trees of a forest for the forest's whole
+//! lifetime. With a placement policy, every worker is pinned to the CPUs of one NUMA node.
+//! Linux allocates a page on the node of the thread that first touches it, so as long as a
+//! worker builds and updates its own trees, their nodes live in the memory of its socket.
+//!
+//! A run gives every worker a deque with the tasks of its own trees. Trees differ a lot in
+//! cost, so a worker that runs out of tasks steals from the back of another worker's deque,
+//! trying the workers on its own node first. A thief that updates a tree allocates its new
+//! nodes on the thief's node, so runs that grow the trees only steal within a node.
+class TreeWorkers {
+public:
+    TreeWorkers(const int &numWorkers, const int &numTrees, const int &placement);
+    ~TreeWorkers();
+
+    //! Runs the task once for every tree and waits until all trees are done. The steal
+    //! policy limits which trees idle workers may take over.
+    void run(TreeTask &task, const int &stealPolicy = STEAL_ANY);
+
+    int numWorkers() const {
+        return (int) m_threads.size();
+    }
+
+    int firstTree(const int &worker) const {
+        return m_firstTree[worker];
+    }
+
+    int lastTree(const int &worker) const {
+        return m_firstTree[worker + 1];
+    }
+
+    //! The NUMA node the worker is pinned to, -1 if it is not pinned
+    int node(const int &worker) const {
+        return m_workerNodes[worker];
+    }
+
+    //! Number of tree tasks run by another worker than the tree's owner
+    long numStolen() const {
+        return m_numStolen.load();
+    }
+
+    long numTasks() const {
+        return m_numTasks;
+    }
+
+private:
+    class TaskQueue {
+    public:
+        mutex m_mutex;
+        deque<int> m_trees;
+    };
+
+    vector<thread> m_threads;
+    vector<int> m_firstTree;
+    vector<int> m_workerNodes;
+    NumaTopology m_topology;
+    vector<TaskQueue*> m_queues;
+    // For every worker, the other workers in the order it tries to steal from them. The
+    // first m_numSameNodeVictims of them are on the worker's node.
+    vector<vector<int> > m_victims;
+    vector<int> m_numSameNodeVictims;
+
+    mutex m_mutex;
+    condition_variable m_startCond;
+    condition_variable m_doneCond;
+    TreeTask *m_task;
+    int m_stealPolicy;
+    long m_generation;
+    int m_numRunning;
+    bool m_stopping;
+
+    atomic<long> m_numStolen;
+    long m_numTasks;
+
+    void work(const int worker);
+    bool popOwn(const int &worker, int &tree);
+    bool steal(const int &worker, const int &stealPolicy, int &tree);
+};
+
+#endif /* TREEWORKERS_H_ */
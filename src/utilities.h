@@ -7,6 +7,9 @@
 #include <fstream>
 #include <vector>
 #include <cmath>
+#include <functional>
+#include <random>
+#include <thread>
 #ifndef WIN32
 #include <unistd.h>
 #include <sys/time.h>
@@ -17,13 +20,13 @@ using namespace std;
 // Random Numbers Generators
 unsigned int getDevRandom();
 
-//! Returns a random number in [0, 1]
-inline double randDouble() {
-    static bool didSeeding = false;
-
-    if (!didSeeding) {
+//! Random number stream of one thread. Threads never share a stream, so they do not contend
+//! for it and can be seeded independently.
+class RandomStream {
+public:
+    RandomStream() {
 #ifdef WIN32
-        srand(0);
+        m_engine.seed(0);
 #else
         unsigned int seedNum;
         struct timeval TV;
@@ -32,12 +35,30 @@ inline double randDouble() {
         gettimeofday(&TV, NULL);
         curTime = (unsigned int) TV.tv_usec;
         seedNum = (unsigned int) time(NULL) + curTime + getpid() + getDevRandom();
+        // Threads started within the same microsecond still get different seeds
+        seedNum += (unsigned int) hash<thread::id>()(this_thread::get_id());
 
-        srand(seedNum);
+        m_engine.seed(seedNum);
 #endif
-        didSeeding = true;
     }
-    return rand() / (RAND_MAX + 1.0);
+
+    mt19937 m_engine;
+};
+
+//! The random number stream of the calling thread, seeded from the clock on first use
+inline mt19937& randomEngine() {
+    static thread_local RandomStream stream;
+    return stream.m_engine;
+}
+
+//! Restarts the random number stream of the calling thread, for reproducible runs
+inline void seedRandom(const unsigned int &seed) {
+    randomEngine().seed(seed);
+}
+
+//! Returns a random number in [0, 1)
+inline double randDouble() {
+    return randomEngine()() / (mt19937::max() + 1.0);
 }
 
 //! Returns a random number in [min, max]
@@ -84,6 +105,13 @@ inline double sum(const vector<double> &inVect) {
     return val;
 }
 
+//! Hint that the memory at address is going to be read soon
+inline void prefetchRead(const void *address) {
+#ifdef __GNUC__
+    __builtin_prefetch(address, 0, 3);
+#endif
+}
+
 //! Poisson sampling
 inline int poisson(double A) {
     int k = 0;
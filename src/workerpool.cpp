@@ -0,0 +1,230 @@
+#include <algorithm>
+
+#include "workerpool.h"
+
+using namespace std;
+
+//! Milliseconds between two time points
+static double elapsedMs(const Clock::time_point &start, const Clock::time_point &end) {
+    return chrono::duration<double, milli>(end - start).count();
+}
+
+void Job::execute() {
+    run();
+    finish();
+}
+
+void Job::finish() {
+    lock_guard<mutex> lock(m_mutex);
+    m_done.store(true);
+    m_cond.notify_all();
+}
+
+void Job::wait() {
+    unique_lock<mutex> lock(m_mutex);
+    while (!m_done.load()) {
+        m_cond.wait(lock);
+    }
+}
+
+WorkerPool& WorkerPool::instance() {
+    static WorkerPool pool;
+    return pool;
+}
+
+void WorkerPool::start(const int &numWorkers, const int &maxQueueLength) {
+    stop();
+
+    m_stopping = false;
+    m_maxQueueLength = maxQueueLength;
+    for (int i = 0; i < numWorkers; i++) {
+        m_workers.push_back(thread(&WorkerPool::work, this));
+    }
+}
+
+void WorkerPool::stop() {
+    deque<Job*> dropped;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+        dropped.swap(m_queue);
+    }
+    m_cond.notify_all();
+
+    vector<Job*> released;
+    for (int i = 0; i < (int) dropped.size(); i++) {
+        if (dropped[i]->m_isOwnedByPool) {
+            released.push_back(dropped[i]);
+        } else {
+            dropped[i]->finish();
+        }
+    }
+
+    for (int i = 0; i < (int) m_workers.size(); i++) {
+        m_workers[i].join();
+    }
+    m_workers.clear();
+
+    // Only once the other jobs are done, releasing may wait for them
+    for (int i = 0; i < (int) released.size(); i++) {
+        released[i]->run();
+        delete released[i];
+    }
+}
+
+bool WorkerPool::submit(Job *job) {
+    job->m_submitTime = Clock::now();
+
+    if (m_workers.empty()) {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_numSubmitted++;
+        }
+        runAndRecord(job);
+        return true;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_maxQueueLength && (int) m_queue.size() >= m_maxQueueLength) {
+            m_numRejected++;
+            return false;
+        }
+
+        m_queue.push_back(job);
+        m_numSubmitted++;
+    }
+    m_cond.notify_one();
+
+    return true;
+}
+
+void WorkerPool::submitAndRelease(Job *job) {
+    job->m_submitTime = Clock::now();
+    job->m_isOwnedByPool = true;
+
+    if (m_workers.empty()) {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_numSubmitted++;
+        }
+        runAndRecord(job);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_queue.push_back(job);
+        m_numSubmitted++;
+    }
+    m_cond.notify_one();
+}
+
+bool WorkerPool::cancel(Job *job) {
+    lock_guard<mutex> lock(m_mutex);
+    deque<Job*>::iterator itr = find(m_queue.begin(), m_queue.end(), job);
+    if (itr == m_queue.end()) {
+        return false;
+    }
+
+    m_queue.erase(itr);
+    return true;
+}
+
+bool WorkerPool::isFull() {
+    if (m_workers.empty()) {
+        return false;
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+    return m_maxQueueLength && (int) m_queue.size() >= m_maxQueueLength;
+}
+
+WorkerPoolStats WorkerPool::getStats() {
+    lock_guard<mutex> lock(m_mutex);
+
+    WorkerPoolStats stats;
+    stats.queueLength = (int) m_queue.size();
+    stats.numSubmitted = m_numSubmitted;
+    stats.numRejected = m_numRejected;
+    stats.numCompleted = m_numCompleted;
+    stats.meanWaitTime = (m_numCompleted) ? m_totalWaitTime / m_numCompleted : 0.0;
+    stats.maxWaitTime = m_maxWaitTime;
+    stats.meanRunTime = (m_numCompleted) ? m_totalRunTime / m_numCompleted : 0.0;
+    stats.maxRunTime = m_maxRunTime;
+
+    return stats;
+}
+
+void WorkerPool::resetStats() {
+    lock_guard<mutex> lock(m_mutex);
+
+    m_numSubmitted = 0;
+    m_numRejected = 0;
+    m_numCompleted = 0;
+    m_totalWaitTime = 0.0;
+    m_maxWaitTime = 0.0;
+    m_totalRunTime = 0.0;
+    m_maxRunTime = 0.0;
+}
+
+//! Takes the queued job with the highest priority, the oldest one on ties. Needs m_mutex.
+Job* WorkerPool::popHighestPriority() {
+    deque<Job*>::iterator best = m_queue.begin();
+    double bestPriority = (*best)->priority();
+    for (deque<Job*>::iterator itr = best + 1; itr != m_queue.end(); ++itr) {
+        double priority = (*itr)->priority();
+        if (priority > bestPriority) {
+            bestPriority = priority;
+            best = itr;
+        }
+    }
+
+    Job *job = *best;
+    m_queue.erase(best);
+    return job;
+}
+
+void WorkerPool::runAndRecord(Job *job) {
+    Clock::time_point startTime = Clock::now();
+    job->run();
+    Clock::time_point endTime = Clock::now();
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        double waitTime = elapsedMs(job->m_submitTime, startTime);
+        double runTime = elapsedMs(startTime, endTime);
+
+        m_numCompleted++;
+        m_totalWaitTime += waitTime;
+        m_maxWaitTime = max(m_maxWaitTime, waitTime);
+        m_totalRunTime += runTime;
+        m_maxRunTime = max(m_maxRunTime, runTime);
+    }
+
+    if (job->m_isOwnedByPool) {
+        delete job;
+    } else {
+        // The owner may free the job as soon as it is done
+        job->finish();
+    }
+}
+
+void WorkerPool::work() {
+    while (true) {
+        Job *job;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            while (!m_stopping && m_queue.empty()) {
+                m_cond.wait(lock);
+            }
+            if (m_stopping) {
+                return;
+            }
+
+            job = popHighestPriority();
+        }
+
+        runAndRecord(job);
+    }
+}
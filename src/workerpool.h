@@ -0,0 +1,134 @@
+#ifndef WORKERPOOL_H_
+#define WORKERPOOL_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+//! A unit of background work. The submitter keeps the ownership of the job.
+class Job {
+public:
+    Job() :
+        m_done(false), m_isOwnedByPool(false) {
+    }
+
+    virtual ~Job() {
+    }
+
+    virtual void run() = 0;
+
+    //! Jobs with a higher priority are run first, it is evaluated when a worker picks a job
+    virtual double priority() const {
+        return 0.0;
+    }
+
+    //! Runs the job and marks it as done
+    void execute();
+
+    //! Marks the job as done without running it
+    void finish();
+
+    bool isDone() const {
+        return m_done.load();
+    }
+
+    //! Blocks until the job has been executed
+    void wait();
+
+private:
+    atomic<bool> m_done;
+    mutex m_mutex;
+    condition_variable m_cond;
+
+    friend class WorkerPool;
+    Clock::time_point m_submitTime;
+    bool m_isOwnedByPool;
+};
+
+//! Job counters and latencies (in ms) of a worker pool
+class WorkerPoolStats {
+public:
+    int queueLength;
+    long numSubmitted;
+    long numRejected;
+    long numCompleted;
+    double meanWaitTime;
+    double maxWaitTime;
+    double meanRunTime;
+    double maxRunTime;
+};
+
+//! Fixed size pool of worker threads with a bounded queue. Workers always pick the queued
+//! job with the highest priority, so the load they put on the machine is bounded by the
+//! number of workers, while the queue depth bounds the memory held by waiting jobs.
+class WorkerPool {
+public:
+    WorkerPool() :
+        m_maxQueueLength(0), m_stopping(false) {
+        resetStats();
+    }
+
+    ~WorkerPool() {
+        stop();
+    }
+
+    //! The process wide pool used for background training
+    static WorkerPool& instance();
+
+    //! Starts the worker threads, with 0 workers jobs are executed inline by submit().
+    //! A maxQueueLength of 0 does not limit the queue.
+    void start(const int &numWorkers, const int &maxQueueLength = 0);
+
+    //! Finishes the running jobs and joins the workers, queued jobs are finished without running
+    void stop();
+
+    //! Queues a job, returns false if the queue is full
+    bool submit(Job *job);
+
+    //! Queues a job that the pool deletes once it has run. It is never rejected, as it only
+    //! releases resources that are held anyway, and stop() runs it if it is still queued.
+    void submitAndRelease(Job *job);
+
+    //! Removes a job that has not started yet, returns false if it is running or done
+    bool cancel(Job *job);
+
+    bool isFull();
+
+    int numWorkers() const {
+        return (int) m_workers.size();
+    }
+
+    WorkerPoolStats getStats();
+    void resetStats();
+
+private:
+    vector<thread> m_workers;
+    deque<Job*> m_queue;
+    int m_maxQueueLength;
+    mutex m_mutex;
+    condition_variable m_cond;
+    bool m_stopping;
+
+    // Statistics, guarded by m_mutex
+    long m_numSubmitted;
+    long m_numRejected;
+    long m_numCompleted;
+    double m_totalWaitTime;
+    double m_maxWaitTime;
+    double m_totalRunTime;
+    double m_maxRunTime;
+
+    void work();
+    Job* popHighestPriority();
+    void runAndRecord(Job *job);
+};
+
+#endif /* WORKERPOOL_H_ */
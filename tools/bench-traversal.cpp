@@ -0,0 +1,116 @@
+// Compares walking one sample at a time down the trees (OnlineRF::eval) with the batch
+// traversal behind OnlineRF::test, on frozen forests of increasing depth. The forests are
+// trained on synthetic data, all other settings come from the config file.
+//
+//     make bench-traversal
+//     ./bench-traversal conf/orf.conf [numSamples]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "../src/data.h"
+#include "../src/hyperparameters.h"
+#include "../src/onlinerf.h"
+#include "../src/utilities.h"
+
+using namespace std;
+
+static const int NUM_FEATURES = 32;
+static const int NUM_CLASSES = 10;
+
+//! Dense samples labelled by the closest of NUM_CLASSES random centers, so deep trees keep
+//! finding splits
+static void makeDataSet(const int &numSamples, const vector<vector<double> > &centers, DataSet &dataset) {
+    dataset.m_samples.clear();
+    dataset.m_numSamples = numSamples;
+    dataset.m_numFeatures = NUM_FEATURES;
+    dataset.m_numClasses = NUM_CLASSES;
+    for (int n = 0; n < numSamples; n++) {
+        Sample sample;
+        resize(sample.x, NUM_FEATURES);
+        double bestDistance = HUGE_VAL;
+        vector<double> x(NUM_FEATURES);
+        for (int i = 0; i < NUM_FEATURES; i++) {
+            x[i] = randDouble();
+            sample.x.w(i, x[i]);
+        }
+        for (int c = 0; c < NUM_CLASSES; c++) {
+            double distance = 0.0;
+            for (int i = 0; i < NUM_FEATURES; i++) {
+                distance += (x[i] - centers[c][i]) * (x[i] - centers[c][i]);
+            }
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                sample.y = c;
+            }
+        }
+        sample.w = 1.0;
+        dataset.m_samples.push_back(sample);
+    }
+    dataset.findFeatRange();
+}
+
+static double elapsedNs(const chrono::steady_clock::time_point &start) {
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cout << "Usage: " << argv[0] << " <config file> [numSamples]" << endl;
+        return EXIT_FAILURE;
+    }
+
+    Hyperparameters hp(argv[1]);
+    // Training dominates the run time, 20000 samples let depth 20 finish in a few minutes
+    int numSamples = (argc > 2) ? atoi(argv[2]) : 20000;
+    hp.numEpochs = 1;
+    hp.earlyExit = 0;
+    hp.numTreeWorkers = 0;
+    hp.counterThreshold = 5;
+    hp.verbose = 0;
+
+    vector<vector<double> > centers(NUM_CLASSES);
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        fillWithRandomNumbers(NUM_FEATURES, centers[c]);
+        for (int i = 0; i < NUM_FEATURES; i++) {
+            centers[c][i] = 0.5 + 0.5 * centers[c][i];
+        }
+    }
+    DataSet trainSet, testSet;
+    makeDataSet(numSamples, centers, trainSet);
+    makeDataSet(numSamples, centers, testSet);
+
+    int depths[] = { 4, 8, 12, 16, 20 };
+    cout << "depth\tKB\tsingle ns/sample\tbatch ns/sample\tspeedup\tmismatches" << endl;
+    for (int d = 0; d < (int) (sizeof(depths) / sizeof(depths[0])); d++) {
+        hp.maxDepth = depths[d];
+        OnlineRF forest(hp, trainSet.m_numClasses, trainSet.m_numFeatures, trainSet.m_minFeatRange,
+                        trainSet.m_maxFeatRange, 0);
+        forest.train(trainSet);
+        forest.freeze();
+
+        vector<Result> single(testSet.m_numSamples);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int n = 0; n < testSet.m_numSamples; n++) {
+            single[n] = forest.eval(testSet.m_samples[n]);
+        }
+        double singleTime = elapsedNs(start) / testSet.m_numSamples;
+
+        start = chrono::steady_clock::now();
+        vector<Result> batch = forest.test(testSet);
+        double batchTime = elapsedNs(start) / testSet.m_numSamples;
+
+        int numMismatches = 0;
+        for (int n = 0; n < testSet.m_numSamples; n++) {
+            if (single[n].prediction != batch[n].prediction || single[n].confidence != batch[n].confidence) {
+                numMismatches++;
+            }
+        }
+
+        cout << depths[d] << "\t" << forest.memoryUsage() / 1024 << "\t" << singleTime << "\t\t\t" << batchTime;
+        cout << "\t\t" << singleTime / batchTime << "\t" << numMismatches << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+// Exercises the ModelRegistry the way a server would: several threads interleave updates and
+// blocking evals on several hosted forests, one model runs into its memory quota and one is
+// removed while its updates are still queued. The forests are trained on synthetic data, all
+// other settings come from the config file. Prints the counters of every model and exits with
+// a failure if any of them is off.
+//
+//     make check-registry
+//     ./check-registry conf/orf.conf [numThreads]
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "../src/data.h"
+#include "../src/hyperparameters.h"
+#include "../src/modelregistry.h"
+#include "../src/utilities.h"
+
+using namespace std;
+
+static const int NUM_FEATURES = 16;
+static const int NUM_CLASSES = 4;
+static const int NUM_MODELS = 4;
+static const int NUM_SAMPLES = 2000;
+// Every thread evaluates after this many updates, coprime to NUM_MODELS so that every model
+// gets evals
+static const int EVAL_INTERVAL = 5;
+
+//! Dense samples labelled by the closest of NUM_CLASSES random centers
+static void makeDataSet(const int &numSamples, const vector<vector<double> > &centers, DataSet &dataset) {
+    dataset.m_samples.clear();
+    dataset.m_numSamples = numSamples;
+    dataset.m_numFeatures = NUM_FEATURES;
+    dataset.m_numClasses = NUM_CLASSES;
+    for (int n = 0; n < numSamples; n++) {
+        Sample sample;
+        resize(sample.x, NUM_FEATURES);
+        double bestDistance = HUGE_VAL;
+        vector<double> x(NUM_FEATURES);
+        for (int i = 0; i < NUM_FEATURES; i++) {
+            x[i] = randDouble();
+            sample.x.w(i, x[i]);
+        }
+        for (int c = 0; c < NUM_CLASSES; c++) {
+            double distance = 0.0;
+            for (int i = 0; i < NUM_FEATURES; i++) {
+                distance += (x[i] - centers[c][i]) * (x[i] - centers[c][i]);
+            }
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                sample.y = c;
+            }
+        }
+        sample.w = 1.0;
+        dataset.m_samples.push_back(sample);
+    }
+    dataset.findFeatRange();
+}
+
+static string modelName(const int &model) {
+    stringstream name;
+    name << "model" << model;
+    return name.str();
+}
+
+//! What one thread did to the registry
+class ClientCounts {
+public:
+    ClientCounts() :
+        numAccepted(NUM_MODELS, 0), numEvals(NUM_MODELS, 0), numBadResults(0) {
+    }
+
+    vector<long> numAccepted;
+    vector<long> numEvals;
+    long numBadResults; // predictions or confidences that are not a distribution
+};
+
+//! Thread t sends its k-th sample to model (k + t) % NUM_MODELS, and evaluates a sample on
+//! the same model every EVAL_INTERVAL updates
+static void runClient(ModelRegistry &registry, DataSet &dataset, const int &thread, const int &numThreads,
+                      ClientCounts &counts) {
+    for (int n = thread; n < dataset.m_numSamples; n += numThreads) {
+        int model = (n / numThreads + thread) % NUM_MODELS;
+        if (registry.update(modelName(model), dataset.m_samples[n])) {
+            counts.numAccepted[model]++;
+        }
+
+        if ((n / numThreads) % EVAL_INTERVAL == 0) {
+            Result result;
+            if (!registry.eval(modelName(model), dataset.m_samples[n], result)) {
+                counts.numBadResults++;
+                continue;
+            }
+            counts.numEvals[model]++;
+            if (result.prediction < 0 || result.prediction >= NUM_CLASSES || fabs(sum(result.confidence) - 1.0) > 1e-6) {
+                counts.numBadResults++;
+            }
+        }
+    }
+}
+
+static bool check(const bool &isOk, const string &what) {
+    cout << ((isOk) ? "ok      " : "FAILED  ") << what << endl;
+    return isOk;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cout << "Usage: " << argv[0] << " <config file> [numThreads]" << endl;
+        return EXIT_FAILURE;
+    }
+
+    Hyperparameters hp(argv[1]);
+    int numThreads = (argc > 2) ? atoi(argv[2]) : 4;
+    hp.counterThreshold = 5;
+    hp.verbose = 0;
+    hp.leafModel = 0;
+    hp.quantizeBits = 0;
+
+    vector<vector<double> > centers(NUM_CLASSES);
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        fillWithRandomNumbers(NUM_FEATURES, centers[c]);
+        for (int i = 0; i < NUM_FEATURES; i++) {
+            centers[c][i] = 0.5 + 0.5 * centers[c][i];
+        }
+    }
+    DataSet trainSet, testSet;
+    makeDataSet(NUM_SAMPLES, centers, trainSet);
+    makeDataSet(NUM_SAMPLES / 4, centers, testSet);
+
+    ModelRegistry registry(numThreads, 16, 128);
+    bool isOk = true;
+
+    // The last model may grow by a quarter of its initial size
+    ModelStats stats;
+    for (int m = 0; m < NUM_MODELS; m++) {
+        registry.add(modelName(m), hp, NUM_CLASSES, NUM_FEATURES, trainSet.m_minFeatRange, trainSet.m_maxFeatRange);
+    }
+    registry.getStats(modelName(NUM_MODELS - 1), stats);
+    long quota = stats.memoryUsage + stats.memoryUsage / 4;
+    registry.remove(modelName(NUM_MODELS - 1));
+    registry.add(modelName(NUM_MODELS - 1), hp, NUM_CLASSES, NUM_FEATURES, trainSet.m_minFeatRange,
+                 trainSet.m_maxFeatRange, quota);
+    isOk &= check(!registry.add(modelName(0), hp, NUM_CLASSES, NUM_FEATURES, trainSet.m_minFeatRange,
+                                trainSet.m_maxFeatRange), "adding a taken name fails");
+
+    // Interleaved updates and evals from all threads
+    vector<ClientCounts> counts(numThreads);
+    vector<thread> clients;
+    for (int t = 0; t < numThreads; t++) {
+        clients.push_back(thread(runClient, ref(registry), ref(trainSet), t, numThreads, ref(counts[t])));
+    }
+    for (int t = 0; t < numThreads; t++) {
+        clients[t].join();
+    }
+
+    cout << "model\tupdates\trejected\tevals\tKB\tquota KB\ttest error" << endl;
+    for (int m = 0; m < NUM_MODELS; m++) {
+        registry.wait(modelName(m));
+        registry.getStats(modelName(m), stats);
+
+        long numAccepted = 0, numEvals = 0, numBadResults = 0;
+        for (int t = 0; t < numThreads; t++) {
+            numAccepted += counts[t].numAccepted[m];
+            numEvals += counts[t].numEvals[m];
+            numBadResults += counts[t].numBadResults;
+        }
+
+        int numErrors = 0;
+        for (int n = 0; n < testSet.m_numSamples; n++) {
+            Result result;
+            registry.eval(modelName(m), testSet.m_samples[n], result);
+            numErrors += (result.prediction != testSet.m_samples[n].y);
+        }
+
+        cout << modelName(m) << "\t" << stats.numUpdates << "\t" << stats.numRejected << "\t\t" << stats.numEvals;
+        cout << "\t" << stats.memoryUsage / 1024 << "\t" << stats.memoryQuota / 1024 << "\t\t";
+        cout << (double) numErrors / testSet.m_numSamples << endl;
+
+        // Every accepted update is applied, unless the model went over its quota in between
+        isOk &= check(stats.numEvals == numEvals, modelName(m) + ": every eval is counted once");
+        isOk &= check(numBadResults == 0, modelName(m) + ": evals return distributions");
+        if (m < NUM_MODELS - 1) {
+            isOk &= check(stats.numUpdates == numAccepted && !stats.numRejected,
+                          modelName(m) + ": every update is applied");
+        } else {
+            isOk &= check(stats.numRejected > 0 && stats.memoryUsage > quota,
+                          modelName(m) + ": updates are rejected over the quota");
+            isOk &= check(!registry.update(modelName(m), trainSet.m_samples[0]),
+                          modelName(m) + ": update fails over the quota");
+        }
+    }
+
+    // Removing a model with queued work waits for it, later requests fail
+    for (int n = 0; n < trainSet.m_numSamples; n++) {
+        registry.update(modelName(0), trainSet.m_samples[n]);
+    }
+    registry.getStats(modelName(0), stats);
+    cout << "removing " << modelName(0) << " with " << stats.queueLength << " queued updates" << endl;
+    isOk &= check(registry.remove(modelName(0)), "remove with queued work succeeds");
+    Result result;
+    isOk &= check(!registry.contains(modelName(0)) && !registry.update(modelName(0), trainSet.m_samples[0])
+                  && !registry.eval(modelName(0), trainSet.m_samples[0], result), "a removed model takes no requests");
+    isOk &= check(registry.names().size() == NUM_MODELS - 1, "the other models are still hosted");
+
+    return (isOk) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
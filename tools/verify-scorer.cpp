@@ -0,0 +1,55 @@
+// Checks a scorer generated by Online-Forest --export against the reference predictions
+// written next to it. Build it together with the generated file:
+//
+//     c++ -O2 -ffp-contract=off model.cpp tools/verify-scorer.cpp -o verify-scorer
+//     ./verify-scorer model.cpp.check
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+extern const int orf_num_features, orf_num_classes;
+int orf_predict(const double *x, double *confidence);
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        cout << "Usage: " << argv[0] << " <check file>" << endl;
+        return EXIT_FAILURE;
+    }
+
+    ifstream fp(argv[1]);
+    if (!fp) {
+        cout << "Could not open input file " << argv[1] << endl;
+        return EXIT_FAILURE;
+    }
+
+    int numSamples, numFeatures;
+    fp >> numSamples >> numFeatures;
+    if (numFeatures != orf_num_features) {
+        cout << "The check file has " << numFeatures << " features, the scorer " << orf_num_features << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<double> x(numFeatures), confidence(orf_num_classes);
+    int numMismatches = 0, expected;
+    for (int n = 0; n < numSamples; n++) {
+        fp >> expected;
+        for (int i = 0; i < numFeatures; i++) {
+            fp >> x[i];
+        }
+        if (!fp) {
+            cout << "Could not read sample " << n << " of " << argv[1] << endl;
+            return EXIT_FAILURE;
+        }
+
+        if (orf_predict(&x[0], &confidence[0]) != expected) {
+            numMismatches++;
+        }
+    }
+
+    cout << "Generated scorer: " << numMismatches << " of " << numSamples << " predictions differ." << endl;
+    return (numMismatches) ? EXIT_FAILURE : EXIT_SUCCESS;
+}